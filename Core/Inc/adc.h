@@ -34,6 +34,14 @@ extern "C" {
 extern ADC_HandleTypeDef hadc1;
 
 /* USER CODE BEGIN Private defines */
+/*
+ * Sampling time of each kind of sensor. The phototransistors of the line sensors have the
+ * highest source impedance and get the longest time. With the 4x oversampling one scan has
+ * to stay below the period of TIM6 (200 us at 5 kHz).
+ */
+#define ADC_SAMPLETIME_LINESENSOR ADC_SAMPLETIME_47CYCLES_5
+#define ADC_SAMPLETIME_ENCODER    ADC_SAMPLETIME_24CYCLES_5
+#define ADC_SAMPLETIME_BATTERY    ADC_SAMPLETIME_47CYCLES_5
 
 /* USER CODE END Private defines */
 
@@ -0,0 +1,78 @@
+/**
+ * @brief  Header file for calibration.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __CALIBRATION_H__
+#define __CALIBRATION_H__
+
+#include <stdint.h>
+
+#include "params.h"
+#include "sensors.h"
+
+typedef struct RobotContext RobotContext;
+
+/* Half periods of the encoder signal the envelope is averaged over, as power of two */
+#define CALIBRATION_AVERAGE_SHIFT 3
+
+/* Half periods that are averaged before the thresholds are moved */
+#define CALIBRATION_MIN_HALF_PERIODS 16
+
+/* Smallest difference between the bright and the dark level that is trusted */
+#define CALIBRATION_MIN_SWING 600
+
+/* Smallest difference between the white and the black level of a line sensor that is trusted */
+#define CALIBRATION_MIN_LINE_SWING 1000
+
+/* Levels of the line sensors until a sweep measured them */
+#define CALIBRATION_LINE_WHITE 400
+#define CALIBRATION_LINE_BLACK 3600
+
+/* Fractional bits of the factor that normalises the values of a line sensor */
+#define CALIBRATION_LINE_SHIFT 8
+
+/* Number of telemetry outputs between two reports of the calibration */
+#define CALIBRATION_REPORT_INTERVAL 200
+
+/* Envelope of the signal of one wheel encoder, written by the ADC interrupt */
+typedef struct
+{
+	int32_t low_sum;          /* Average of the minima of the bright half periods, scaled by 2^CALIBRATION_AVERAGE_SHIFT */
+	int32_t high_sum;         /* Average of the maxima of the dark half periods, likewise */
+	uint16_t extreme;         /* Extreme of the current half period */
+	uint8_t state;            /* Threshold, side of the band the signal is on */
+	uint16_t half_periods;    /* Completed half periods, saturates */
+} EncoderEnvelope;
+
+/* Levels of one line sensor, the raw values are higher on black */
+typedef struct
+{
+	uint16_t white;         /* Raw value on the white floor */
+	uint16_t black;         /* Raw value on the line */
+	int32_t scale;          /* Q16_ONE / (black - white), scaled by 2^CALIBRATION_LINE_SHIFT */
+	uint16_t sweep_min;     /* Extremes of the raw values during the current sweep */
+	uint16_t sweep_max;
+} LineLevels;
+
+typedef struct
+{
+	EncoderEnvelope left;
+	EncoderEnvelope right;
+	LineLevels line[LINE_SENSORS];
+	uint32_t report_counter;
+} Calibration;
+
+void calibration_trackEncoder(EncoderEnvelope* envelope, uint16_t value, uint16_t* low, uint16_t* high, uint16_t enabled);
+void calibration_init(Calibration* calibration, Params* params);
+uint8_t calibration_save(const Calibration* calibration, const Params* params);
+void calibration_reset(Calibration* calibration);
+void calibration_startLineSweep(Calibration* calibration);
+void calibration_trackLine(Calibration* calibration, const SensorFrame* frame);
+uint8_t calibration_finishLineSweep(Calibration* calibration);
+void calibration_lineReflectance(const Calibration* calibration, const SensorFrame* frame, q16_t* reflectance);
+uint16_t calibration_lineBlack(const Calibration* calibration, q16_t level);
+void calibration_report(RobotContext* robot);
+
+#endif /* __CALIBRATION_H__ */
@@ -0,0 +1,37 @@
+/**
+ * @brief  Header file for command.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __COMMAND_H__
+#define __COMMAND_H__
+
+#include "main.h"
+
+typedef struct RobotContext RobotContext;
+
+/* Size of the receive buffer the DMA writes in circular mode */
+#define COMMAND_RX_SIZE 256
+
+/* Longest command line */
+#define COMMAND_MAX_LINE 64
+
+/* Command interface on USART2 */
+typedef struct
+{
+	uint8_t rx[COMMAND_RX_SIZE];
+	volatile uint32_t rx_head;    /* Position of the DMA in rx at the latest reception event */
+	uint32_t rx_tail;             /* Next byte to parse */
+	char line[COMMAND_MAX_LINE];
+	uint32_t line_len;
+	uint8_t line_overflow;        /* The current line is too long and is ignored */
+	int32_t list_index;           /* Next parameter of a pending "list", -1 if none */
+	volatile uint8_t rx_stopped;  /* The HAL stopped the reception after an error */
+} Command;
+
+void command_init(RobotContext* robot);
+void command_receptionStopped(RobotContext* robot);
+void command_poll(RobotContext* robot);
+
+#endif /* __COMMAND_H__ */
@@ -7,10 +7,11 @@
 #ifndef __DRIVING_H__
 #define __DRIVING_H__
 
-extern double speed_left;
-extern double speed_right;
+#include "fixedpoint.h"
 
-void drive(double speed_left, double speed_right);
-void driveForward();
+typedef struct RobotContext RobotContext;
+
+void drive(RobotContext* robot, q16_t speed_left, q16_t speed_right);
+void driveForward(RobotContext* robot);
 
 #endif /* __DRIVING_H__ */
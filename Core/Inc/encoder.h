@@ -0,0 +1,21 @@
+/**
+ * @brief  Header file for encoder.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __ENCODER_H__
+#define __ENCODER_H__
+
+#include <stdint.h>
+
+typedef struct RobotContext RobotContext;
+
+#ifdef ENCODER_COMPARATORS
+
+void encoder_init(RobotContext* robot);
+void encoder_update(RobotContext* robot, uint32_t timestamp);
+
+#endif /* ENCODER_COMPARATORS */
+
+#endif /* __ENCODER_H__ */
@@ -0,0 +1,53 @@
+/**
+ * @brief  Header file for events.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+#include <stdint.h>
+
+typedef struct RobotContext RobotContext;
+
+#ifdef ADC_WATCHDOGS
+
+#ifdef ENCODER_COMPARATORS
+#error "ADC_WATCHDOGS and ENCODER_COMPARATORS both count the encoder edges, define only one of them"
+#endif
+
+/* Number of events the queue holds (must be a power of two) */
+#define EVENT_QUEUE_SIZE 16
+
+typedef enum
+{
+	EVENT_ENCODER_LEFT,
+	EVENT_ENCODER_RIGHT,
+	EVENT_LINE
+} SensorEventSource;
+
+/* Threshold crossing reported by an analog watchdog, 8 bytes */
+typedef struct
+{
+	uint32_t timestamp;  /* Time of the interrupt in us */
+	uint8_t source;      /* SensorEventSource */
+	uint8_t level;       /* Threshold the encoder signal crossed, unused for the line sensors */
+} SensorEvent;
+
+/* Written by the ADC interrupt, read by the ADC DMA interrupt of the same priority */
+typedef struct
+{
+	SensorEvent events[EVENT_QUEUE_SIZE];
+	volatile uint8_t head;  /* Next event to write */
+	volatile uint8_t tail;  /* Next event to read */
+	uint32_t dropped;       /* Events lost because the queue was full */
+} EventQueue;
+
+void events_init(RobotContext* robot);
+void events_process(RobotContext* robot);
+void events_watchLine(RobotContext* robot);
+
+#endif /* ADC_WATCHDOGS */
+
+#endif /* __EVENTS_H__ */
@@ -0,0 +1,35 @@
+/**
+ * @brief  Header file for filter.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <stdint.h>
+
+/* Largest window of the moving average as a power of two */
+#define FILTER_MAX_SHIFT 4
+#define FILTER_MAX_WINDOW (1 << FILTER_MAX_SHIFT)
+
+typedef enum {FILTER_NONE, FILTER_IIR, FILTER_MOVING_AVERAGE} FilterType;
+
+/*
+ * Digital low-pass filter for one ADC channel in fixed-point arithmetic.
+ * shift sets the smoothing: the IIR uses the factor 2^-shift, the moving average
+ * a window of 2^shift samples.
+ */
+typedef struct
+{
+	FilterType type;
+	uint8_t shift;
+	uint32_t state;
+	uint8_t index;
+	uint16_t history[FILTER_MAX_WINDOW];
+} Filter;
+
+void filter_init(Filter* filter, FilterType type, uint8_t shift, uint16_t initial);
+uint16_t filter_update(Filter* filter, uint16_t sample);
+
+#endif /* __FILTER_H__ */
@@ -0,0 +1,123 @@
+/**
+ * @brief  Fixed-point arithmetic for the motor control.
+ *
+ * The FPU of the Cortex-M4F only handles single precision, every double operation ends up in
+ * a software routine. Speeds, gains and corrections are therefore kept as Q16.16 numbers,
+ * i.e. 1.0 is represented by 65536.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __FIXEDPOINT_H__
+#define __FIXEDPOINT_H__
+
+#include <stdint.h>
+
+typedef int32_t q16_t;
+
+#define Q16_SHIFT 16
+#define Q16_ONE   ((q16_t) 1 << Q16_SHIFT)
+#define Q16_MAX   INT32_MAX
+#define Q16_MIN   INT32_MIN
+
+/* Converts a constant into Q16.16 at compile time (rounded to the nearest value) */
+#define Q16(x) ((q16_t) ((x) * 65536.0 + ((x) >= 0 ? 0.5 : -0.5)))
+
+/**
+ * @brief  Limits a value to an interval.
+ *
+ * @param  x value to limit
+ * @param  min lower bound
+ * @param  max upper bound
+ * @return limited value
+ */
+static inline q16_t q16_saturate(q16_t x, q16_t min, q16_t max)
+{
+	if (x < min)
+	{
+		return min;
+	}
+	if (x > max)
+	{
+		return max;
+	}
+	return x;
+}
+
+/**
+ * @brief  Limits a 64 bit intermediate result to the range of Q16.16.
+ *
+ * @param  x intermediate result
+ * @return saturated value
+ */
+static inline q16_t q16_saturate64(int64_t x)
+{
+	if (x > Q16_MAX)
+	{
+		return Q16_MAX;
+	}
+	if (x < Q16_MIN)
+	{
+		return Q16_MIN;
+	}
+	return (q16_t) x;
+}
+
+/**
+ * @brief  Saturating addition.
+ *
+ * @return a + b
+ */
+static inline q16_t q16_add(q16_t a, q16_t b)
+{
+	return q16_saturate64((int64_t) a + b);
+}
+
+/**
+ * @brief  Saturating subtraction.
+ *
+ * @return a - b
+ */
+static inline q16_t q16_sub(q16_t a, q16_t b)
+{
+	return q16_saturate64((int64_t) a - b);
+}
+
+/**
+ * @brief  Saturating multiplication of two Q16.16 numbers.
+ *
+ * @return a * b
+ */
+static inline q16_t q16_mul(q16_t a, q16_t b)
+{
+	return q16_saturate64(((int64_t) a * b) >> Q16_SHIFT);
+}
+
+/**
+ * @brief  Saturating multiplication of a Q16.16 number with an integer.
+ *
+ * @return a * n
+ */
+static inline q16_t q16_mulInt(q16_t a, int32_t n)
+{
+	return q16_saturate64((int64_t) a * n);
+}
+
+/**
+ * @brief  Scales a value in Q16.16 to an integer range, e.g. a speed to a PWM value.
+ *
+ * @param  x value to scale
+ * @param  scale integer that corresponds to 1.0
+ * @return x * scale, truncated towards zero
+ */
+static inline int32_t q16_scale(q16_t x, int32_t scale)
+{
+	int64_t product = (int64_t) x * scale;
+	if (product < 0)
+	{
+		return (int32_t) -((-product) >> Q16_SHIFT);
+	}
+	return (int32_t) (product >> Q16_SHIFT);
+}
+
+#endif /* __FIXEDPOINT_H__ */
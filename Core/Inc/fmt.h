@@ -0,0 +1,28 @@
+/**
+ * @brief  Header file for fmt.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include <stdint.h>
+
+/* Text being built in a buffer of the caller, the text is not terminated by '\0' */
+typedef struct
+{
+	char* data;
+	uint32_t size;
+	uint32_t len;
+} FmtBuffer;
+
+void fmt_init(FmtBuffer* out, char* data, uint32_t size);
+void fmt_char(FmtBuffer* out, char c);
+void fmt_string(FmtBuffer* out, const char* string);
+void fmt_unsigned(FmtBuffer* out, uint32_t value, uint8_t width);
+void fmt_signed(FmtBuffer* out, int32_t value, uint8_t width);
+void fmt_hex(FmtBuffer* out, uint32_t value, uint8_t digits);
+void fmt_fixed(FmtBuffer* out, int32_t value, uint8_t decimals);
+
+#endif /* __FMT_H__ */
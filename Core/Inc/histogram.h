@@ -0,0 +1,31 @@
+/**
+ * @brief  Header file for histogram.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdint.h>
+
+#include "fmt.h"
+
+/* Buckets of a histogram, bucket n counts values in [2^n, 2^(n+1)) (bucket 0 also 0) */
+#define HISTOGRAM_BUCKETS 32
+
+/* Distribution of a value, e.g. a time in us or in cycles */
+typedef struct
+{
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+void histogram_add(Histogram* histogram, uint32_t value);
+void histogram_copy(Histogram* copy, const Histogram* histogram);
+void histogram_format(FmtBuffer* out, const Histogram* histogram);
+
+#endif /* __HISTOGRAM_H__ */
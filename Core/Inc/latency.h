@@ -0,0 +1,43 @@
+/**
+ * @brief  Header file for latency.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdint.h>
+
+#include "sensors.h"
+#include "histogram.h"
+
+typedef struct RobotContext RobotContext;
+
+/* Number of telemetry outputs between two reports of all histograms */
+#define LATENCY_REPORT_INTERVAL 200
+
+typedef enum
+{
+	LATENCY_SENSOR_TO_PWM,   /* Scan a behaviour decision was based on until its PWM write */
+	LATENCY_ENCODER_TO_PWM,  /* Latest encoder scan until the PWM write of the velocity control */
+	LATENCY_CONTROL_JITTER,  /* Deviation of the period of the velocity control from nominal */
+	LATENCY_HISTOGRAMS
+} LatencyKind;
+
+/* Latency tracing of the control loop, the histograms are written by the TIM7 interrupt */
+typedef struct
+{
+	Histogram histograms[LATENCY_HISTOGRAMS];  /* Times in us */
+	volatile uint32_t decision_timestamp;  /* Scan of the latest behaviour decision */
+	volatile uint8_t decision_pending;     /* The decision has not reached the PWM yet */
+	uint32_t last_control;                 /* Start of the previous control period */
+	uint32_t report_counter;
+} Latency;
+
+void latency_decision(RobotContext* robot, const SensorFrame* frame);
+void latency_controlPeriod(RobotContext* robot);
+void latency_pwmWritten(RobotContext* robot, uint32_t frame_timestamp);
+void latency_report(RobotContext* robot);
+
+#endif /* __LATENCY_H__ */
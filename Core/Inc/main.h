@@ -14,8 +14,7 @@ extern "C" {
 
 #include "stm32l4xx_hal.h"
 
-typedef enum {FOLLOW_TRAJECTORY, FOLLOW_LINE, SEARCH_LINE, AVOID_OBSTACLE, FINISH_LINE} RaceState;
-extern RaceState current_state;
+typedef enum {FOLLOW_TRAJECTORY, FOLLOW_LINE, SEARCH_LINE, AVOID_OBSTACLE, FINISH_LINE, CALIBRATE_LINE} RaceState;
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
@@ -0,0 +1,42 @@
+/**
+ * @brief  Header file for odometry.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __ODOMETRY_H__
+#define __ODOMETRY_H__
+
+#include <stdint.h>
+
+typedef struct RobotContext RobotContext;
+
+/*
+ * Distance between the contact points of both wheels in mm. Calibrated from the former
+ * 0.13 ticks per degree of a turn on the spot together with ENCODER_TICK_MM.
+ */
+#define WHEEL_BASE_MM 78.0f
+
+/* Position and heading of the robot relative to where the odometry was reset */
+typedef struct
+{
+	float x;        /* Position in mm */
+	float y;        /* Position in mm */
+	float theta;    /* Heading in rad, counter-clockwise, not wrapped to [-pi, pi] */
+	float distance; /* Distance travelled by the centre of the robot in mm, negative backwards */
+} Pose;
+
+/* Odometry integrated in the TIM7 interrupt */
+typedef struct
+{
+	Pose pose;
+	volatile uint32_t lock;  /* Seqlock protecting pose against torn reads, odd while it is written */
+	int32_t last_ticks_left;
+	int32_t last_ticks_right;
+} Odometry;
+
+void resetOdometry(RobotContext* robot);
+void updateOdometry(RobotContext* robot);
+void getPose(RobotContext* robot, Pose* pose);
+
+#endif /* __ODOMETRY_H__ */
@@ -0,0 +1,85 @@
+/**
+ * @brief  Header file for params.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __PARAMS_H__
+#define __PARAMS_H__
+
+#include <stdint.h>
+
+#include "fixedpoint.h"
+
+/* Tunable parameters of the sensors and the tasks */
+typedef struct
+{
+	/* Gains of the P-controllers */
+	q16_t line_gain;              /* Velocity difference in mm/s per unit of reflectance between the line sensors */
+	q16_t straight_gain;          /* Relative speed correction per encoder tick of difference */
+
+	/* Target velocity of both wheels while driving straight ahead in mm/s */
+	q16_t normal_speed;
+
+	/* Schmitt trigger thresholds of the wheel encoders */
+	uint16_t encoder_left_high;
+	uint16_t encoder_left_low;
+	uint16_t encoder_right_high;
+	uint16_t encoder_right_low;
+	uint16_t encoder_calibration; /* 1 if the thresholds follow the encoder signals */
+
+	/* Reflectance below which the brightness sensors see black */
+	q16_t black_level;
+
+	/* Sweep over the line at the start that measures the levels of the line sensors, read by robot_init() */
+	uint16_t line_calibration;    /* 1 if the race starts with the sweep, not in the registry */
+	float line_sweep_degree;      /* Angle turned to each side */
+
+	/* Sections of the yellow trajectory (in mm and degree) */
+	float first_straight_length;
+	float right_curve_degree;
+	float second_straight_length;
+	float left_curve_degree;
+	float third_straight_length;
+
+	/* Perimeter that is checked for the line (in degree and mm) */
+	float half_perimeter_degree;
+	float next_perimeter_length;
+
+	/* Avoiding the obstacle (in mm and degree) */
+	float obstacle_reverse_length;
+	float obstacle_turn_degree;
+
+	/* Distance in mm after the obstacle that indicates the last part of the course */
+	float last_part_indication;
+
+	/* Distance in mm until the robot eventually stops after the finish line */
+	float finish_line_spurt;
+} Params;
+
+/* How a parameter is stored in Params */
+typedef enum {PARAM_Q16, PARAM_U16, PARAM_FLOAT} ParamType;
+
+/*
+ * Entry of the registry of the parameters that can be changed at runtime. The values of a
+ * parameter are exchanged as integers in units of 10^-decimals of its type (see params_decimals()).
+ */
+typedef struct
+{
+	const char* name;
+	ParamType type;
+	uint16_t offset;  /* Position within Params */
+	int32_t min;
+	int32_t max;
+} ParamInfo;
+
+extern const Params default_params;
+extern const ParamInfo param_registry[];
+extern const uint32_t param_count;
+
+const ParamInfo* params_find(const char* name, uint32_t len);
+uint8_t params_decimals(ParamType type);
+int32_t params_get(const Params* params, const ParamInfo* info);
+uint8_t params_set(Params* params, const ParamInfo* info, int32_t value);
+
+#endif /* __PARAMS_H__ */
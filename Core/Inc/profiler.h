@@ -0,0 +1,59 @@
+/**
+ * @brief  Header file for profiler.c.
+ *
+ * Zones are opened with PROFILE_ZONE() at the top of a function or block and closed
+ * automatically when it is left, also through an early return. Without PROFILING the macro
+ * expands to nothing, so profiling costs neither cycles nor memory.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdint.h>
+
+/* Functions with a timing zone */
+typedef enum
+{
+	PROFILE_ADC_BLOCK,
+	PROFILE_SCHMITT_TRIGGER,
+	PROFILE_DETECT_COLOUR,
+	PROFILE_FOLLOW_TRAJECTORY,
+	PROFILE_FOLLOW_LINE,
+	PROFILE_SEARCH_LINE,
+	PROFILE_AVOID_OBSTACLE,
+	PROFILE_FINISH_LINE,
+	PROFILE_CALIBRATE_LINE,
+	PROFILE_ZONES
+} ProfileZone;
+
+#ifdef PROFILING
+
+#include "main.h"
+#include "telemetry.h"
+#include "histogram.h"
+
+/* Open zone, closed by profiler_leave() when the variable goes out of scope */
+typedef struct
+{
+	ProfileZone zone;
+	uint32_t start;
+} ProfileScope;
+
+#define PROFILE_ZONE(zone) \
+	ProfileScope profile_scope __attribute__((cleanup(profiler_leave))) = {(zone), DWT->CYCCNT}
+
+void profiler_init();
+void profiler_leave(ProfileScope* scope);
+void profiler_reset();
+void profiler_requestReport();
+void profiler_poll(Telemetry* telemetry);
+
+#else
+
+#define PROFILE_ZONE(zone) do {} while (0)
+
+#endif /* PROFILING */
+
+#endif /* __PROFILER_H__ */
@@ -0,0 +1,104 @@
+/**
+ * @brief  Header file for protocol.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#include <stdint.h>
+
+/* Version of the frame layout, sent in the upper nibble of the first byte */
+#define PROTOCOL_VERSION 1
+
+typedef enum {PROTOCOL_SAMPLE = 1, PROTOCOL_TEXT = 2, PROTOCOL_RECORD = 3} ProtocolType;
+
+/* Fields a sample frame can carry, in the order they are encoded */
+#define PROTOCOL_FIELD_ADC      0x01
+#define PROTOCOL_FIELD_ENCODERS 0x02
+#define PROTOCOL_FIELD_STATE    0x04
+#define PROTOCOL_FIELD_PWM      0x08
+#define PROTOCOL_FIELDS_ALL     0x0F
+
+/* Set in the field byte of a key frame, whose values do not depend on the previous frame */
+#define PROTOCOL_KEY 0x80
+
+/* Number of sample frames after which a key frame is sent at the latest */
+#define PROTOCOL_KEY_INTERVAL 32
+
+#define PROTOCOL_ADC_CHANNELS 6
+
+/* Longest text of a text frame */
+#define PROTOCOL_MAX_TEXT 400
+
+/* Buffer size that holds any encoded frame including the COBS overhead and the delimiter */
+#define PROTOCOL_MAX_FRAME (PROTOCOL_MAX_TEXT + 8)
+
+/* Buffer size that holds any encoded record frame */
+#define PROTOCOL_MAX_RECORD_FRAME 64
+
+/* Errors of protocol_decode() */
+#define PROTOCOL_ERROR_FRAMING -1
+#define PROTOCOL_ERROR_CRC     -2
+#define PROTOCOL_ERROR_VERSION -3
+#define PROTOCOL_ERROR_NO_KEY  -4
+
+/* Values of one sample frame */
+typedef struct
+{
+	uint32_t timestamp;                       /* Time of the latest scan in us */
+	uint16_t adc[PROTOCOL_ADC_CHANNELS];      /* 12 bit samples */
+	int32_t encoder_left;                     /* Total ticks */
+	int32_t encoder_right;
+	uint8_t state;                            /* RaceState */
+	int32_t pwm_left;                         /* Compare value, negative backwards */
+	int32_t pwm_right;
+} ProtocolSample;
+
+/* Entry of the flight recorder */
+typedef struct
+{
+	uint8_t trigger;         /* RecorderTrigger that froze the recorder, 0 while recording */
+	uint8_t sub_state;       /* State within the task of the sample */
+	int32_t position;        /* Records after the trigger, negative before */
+	ProtocolSample sample;
+} ProtocolRecord;
+
+/* State of one direction of the link, the delta encoding refers to the previous sample */
+typedef struct
+{
+	uint8_t fields;          /* Fields the encoder sends */
+	uint8_t sequence;        /* Number of the next frame */
+	uint8_t frames_to_key;   /* Sample frames until the next key frame, 0 forces one */
+	uint8_t receiving;       /* Decoder: sequence holds the number of the next frame */
+	uint8_t synchronised;    /* Decoder: previous holds the values of the last sample */
+	ProtocolSample previous;
+} ProtocolStream;
+
+/* Decoded frame */
+typedef struct
+{
+	ProtocolType type;
+	uint8_t fields;          /* Fields the sample carried, without PROTOCOL_KEY */
+	uint8_t key;
+	uint8_t sequence;
+	uint8_t lost;            /* Frames missing before this one */
+	ProtocolSample sample;
+	ProtocolRecord record;
+	char text[PROTOCOL_MAX_TEXT + 1];
+	uint32_t text_len;
+} ProtocolMessage;
+
+uint16_t protocol_crc16(const uint8_t* data, uint32_t len);
+uint32_t protocol_cobsEncode(const uint8_t* data, uint32_t len, uint8_t* out);
+uint32_t protocol_cobsDecode(const uint8_t* data, uint32_t len, uint8_t* out);
+
+void protocol_init(ProtocolStream* stream, uint8_t fields);
+void protocol_resync(ProtocolStream* stream);
+uint32_t protocol_encodeSample(ProtocolStream* stream, const ProtocolSample* sample, uint8_t* out);
+uint32_t protocol_encodeText(ProtocolStream* stream, const char* text, uint32_t len, uint8_t* out);
+uint32_t protocol_encodeRecord(ProtocolStream* stream, const ProtocolRecord* record, uint8_t* out);
+int32_t protocol_decode(ProtocolStream* stream, const uint8_t* frame, uint32_t len, ProtocolMessage* message);
+
+#endif /* __PROTOCOL_H__ */
@@ -0,0 +1,69 @@
+/**
+ * @brief  Header file for recorder.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <stdint.h>
+
+#include "sensors.h"
+
+typedef struct RobotContext RobotContext;
+
+/* Number of records (must be a power of two), 5.12 s at the rate of the behaviour steps */
+#define RECORDER_RECORDS 1024
+
+/* Records that are still written after a trigger, so the reaction is recorded too */
+#define RECORDER_POST_TRIGGER 100
+
+/* Direction bits of a record */
+#define RECORDER_LEFT_BACKWARDS  0x01
+#define RECORDER_RIGHT_BACKWARDS 0x02
+
+typedef enum
+{
+	RECORDER_NONE,
+	RECORDER_LINE_LOST,
+	RECORDER_FINISH,
+	RECORDER_ERROR,
+	RECORDER_COMMAND
+} RecorderTrigger;
+
+/* Sensors and actuators of one behaviour step, 32 bytes */
+typedef struct
+{
+	uint32_t timestamp;             /* Time of the scan in us */
+	uint16_t adc[ADC_CHANNELS];     /* Filtered scan the step was based on */
+	int32_t encoder_left;           /* Total ticks */
+	int32_t encoder_right;
+	uint16_t pwm_left;              /* Compare values, the direction is in direction */
+	uint16_t pwm_right;
+	uint8_t state;                  /* RaceState after the step */
+	uint8_t sub_state;              /* State within the task */
+	uint8_t direction;              /* RECORDER_*_BACKWARDS */
+} RecorderRecord;
+
+/* Ring of the latest records, frozen some time after a trigger until it is rearmed */
+typedef struct
+{
+	RecorderRecord records[RECORDER_RECORDS];
+	uint32_t count;              /* Records written since the recorder was armed */
+	uint32_t trigger_count;      /* count when the trigger fired */
+	uint16_t remaining;          /* Records until the recorder freezes after the trigger */
+	uint8_t trigger;             /* RecorderTrigger, RECORDER_NONE while recording freely */
+	volatile uint8_t frozen;
+	int32_t dump_index;          /* Next record to send, -1 if no dump is running */
+} Recorder;
+
+void recorder_arm(Recorder* recorder);
+void recorder_record(RobotContext* robot, const SensorFrame* frame);
+void recorder_trigger(Recorder* recorder, RecorderTrigger trigger);
+void recorder_freeze(Recorder* recorder, RecorderTrigger trigger);
+uint32_t recorder_startDump(Recorder* recorder);
+void recorder_poll(RobotContext* robot);
+void recorder_dumpBlocking(RobotContext* robot);
+
+#endif /* __RECORDER_H__ */
@@ -0,0 +1,79 @@
+/**
+ * @brief  Header file for robot.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __ROBOT_H__
+#define __ROBOT_H__
+
+#include "main.h"
+#include "params.h"
+#include "sensors.h"
+#include "velocity.h"
+#include "odometry.h"
+#include "tasks.h"
+#include "telemetry.h"
+#include "latency.h"
+#include "command.h"
+#include "recorder.h"
+#include "calibration.h"
+
+/*
+ * Storage class of robot_active. The firmware has a single instance, the host build defines
+ * it as __thread so that every thread can drive its own instances.
+ */
+#ifndef ROBOT_THREAD_LOCAL
+#define ROBOT_THREAD_LOCAL
+#endif
+
+/* Complete runtime state of one robot */
+struct RobotContext
+{
+	Params params;
+	Sensors sensors;
+	VelocityControl velocity;
+	Odometry odometry;
+	Tasks tasks;
+	Telemetry telemetry;
+	Latency latency;
+	Command command;
+	Recorder recorder;
+	Calibration calibration;
+
+	/* Encoder ticks since the last call of resetEncoderCnt() and the totals at that time */
+	int32_t encoder_left_cnt;
+	int32_t encoder_right_cnt;
+	int32_t encoder_left_origin;
+	int32_t encoder_right_origin;
+
+	/* Target velocity of the wheels in mm/s */
+	q16_t speed_left;
+	q16_t speed_right;
+
+	/* Reflectance of each line sensor in the current step, 0 on the line and 1 on the floor */
+	q16_t line_reflectance[LINE_SENSORS];
+
+	Linesensor left_linesensor_state;
+	Linesensor middle_linesensor_state;
+	Linesensor right_linesensor_state;
+
+	RaceState current_state;
+
+	/* Pose of the current behaviour step */
+	Pose pose;
+
+	/* Last time each LED was toggled */
+	uint32_t last_switch_left;
+	uint32_t last_switch_right;
+	uint32_t last_switch_tail;
+};
+
+/* Instance the interrupt callbacks work on */
+extern ROBOT_THREAD_LOCAL RobotContext* robot_active;
+
+void robot_init(RobotContext* robot);
+void robot_step(RobotContext* robot);
+void robot_outputTelemetry(RobotContext* robot);
+
+#endif /* __ROBOT_H__ */
@@ -0,0 +1,25 @@
+/**
+ * @brief  Header file for scheduler.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "main.h"
+
+/* Periodic job of the cooperative scheduler */
+typedef struct
+{
+	const char* name;
+	uint32_t period;          /* Time between two releases in ms (SysTick ticks) */
+	void (*run)();            /* Work of the job, must return before the next release */
+	uint32_t next_release;    /* Tick at which the job is due next */
+	uint32_t overruns;        /* Number of releases that were missed */
+	uint32_t max_duration;    /* Longest execution time in us */
+} Job;
+
+void scheduler_run(Job* jobs, uint32_t count);
+
+#endif /* __SCHEDULER_H__ */
@@ -8,27 +8,86 @@
 #define __SENSORS_H__
 
 #include "adc.h"
+#include "filter.h"
+#include "events.h"
 
-/* Sensors of the Armuro 1 robot */
-#define LINESENSOR_MIDDLE adc[0]
-#define ENCODER_LEFT      adc[1]
-#define LINESENSOR_RIGHT  adc[2]
-#define BATTERY           adc[3]
-#define ENCODER_RIGHT     adc[4]
-#define LINESENSOR_LEFT   adc[5]
+typedef struct RobotContext RobotContext;
 
-extern volatile uint32_t adc[6];
-extern uint32_t buffer[6];
+/* Position of the sensors of the Armuro 1 robot within one scan of the ADC */
+#define CH_LINESENSOR_MIDDLE 0
+#define CH_ENCODER_LEFT      1
+#define CH_LINESENSOR_RIGHT  2
+#define CH_BATTERY           3
+#define CH_ENCODER_RIGHT     4
+#define CH_LINESENSOR_LEFT   5
+#define ADC_CHANNELS         6
 
-extern uint32_t encoder_left_cnt;
-extern uint32_t encoder_right_cnt;
+/* Line sensors from left to right, e.g. for their levels and reflectances */
+typedef enum {LINE_LEFT, LINE_MIDDLE, LINE_RIGHT, LINE_SENSORS} LinesensorIndex;
+
+/* Number of scans the DMA buffer holds, half of them are processed at once (must be even) */
+#define ADC_DMA_FRAMES 8
+
+/* Distance a wheel travels per encoder tick in mm */
+#define ENCODER_TICK_MM (1.0f / 0.19f)
+
+/* Consistent view of all sensors at one point in time */
+typedef struct
+{
+	uint32_t sequence;            /* Number of the ADC block the frame was taken from */
+	uint32_t timestamp;           /* Time of the latest scan in microseconds */
+	uint16_t adc[ADC_CHANNELS];   /* Latest scan of all channels */
+	int32_t encoder_left_ticks;   /* Total number of ticks of the left encoder */
+	int32_t encoder_right_ticks;  /* Total number of ticks of the right encoder */
+	uint32_t edge_left_timestamp; /* Time of the scan with the latest edge of the left encoder in us */
+	uint32_t edge_right_timestamp;
+	uint32_t edge_left_interval;  /* Time between the two latest edges in us, 0 before the second */
+	uint32_t edge_right_interval;
+#ifdef ADC_WATCHDOGS
+	uint8_t line_quiet;           /* No line sensor saw black since detectColour() saw all white */
+#endif
+} SensorFrame;
 
 typedef enum {BLACK, WHITE} Linesensor;
-extern Linesensor left_linesensor_state;
-extern Linesensor middle_linesensor_state;
-extern Linesensor right_linesensor_state;
+typedef enum {LOW, HIGH} Threshold;
+
+/* State of the acquisition, only written by the DMA and the ADC interrupt */
+typedef struct
+{
+	uint32_t buffer[ADC_DMA_FRAMES * ADC_CHANNELS];  /* Scans written by the DMA in circular mode */
+	Filter filters[ADC_CHANNELS];
+	Threshold threshold_left_state;
+	Threshold threshold_right_state;
+	volatile int32_t encoder_left_ticks;             /* Total number of ticks, negative backwards */
+	volatile int32_t encoder_right_ticks;
+	uint32_t edge_left_timestamp;                    /* Latest edges, see SensorFrame */
+	uint32_t edge_right_timestamp;
+	uint32_t edge_left_interval;
+	uint32_t edge_right_interval;
+	uint8_t edge_left_seen;                          /* An edge was recorded, any timestamp is valid */
+	uint8_t edge_right_seen;
+#ifdef ENCODER_COMPARATORS
+	uint16_t counter_left;                           /* LPTIM counters at the last update */
+	uint16_t counter_right;
+#endif
+#ifdef ADC_WATCHDOGS
+	EventQueue events;                               /* Threshold crossings of the analog watchdogs */
+	volatile uint8_t line_quiet;
+#endif
+
+	/*
+	 * Seqlock protecting the published frame: the sequence is odd while the interrupt writes
+	 * the frame, a reader retries if it changed during its copy.
+	 */
+	volatile uint32_t frame_lock;
+	SensorFrame published_frame;
+} Sensors;
 
-void SchmittTrigger();
-void detectColour();
+void initSensorFilters(RobotContext* robot);
+void recordEncoderEdge(uint32_t* last_edge, uint32_t* interval, uint8_t* seen, uint32_t timestamp);
+void SchmittTrigger(RobotContext* robot, const uint32_t* frame, uint32_t timestamp);
+void getSensorFrame(RobotContext* robot, SensorFrame* frame);
+void outputSensor(RobotContext* robot, const SensorFrame* frame);
+void detectColour(RobotContext* robot, const SensorFrame* frame);
 
 #endif /* __SENSORS_H__ */
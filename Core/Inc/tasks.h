@@ -7,10 +7,33 @@
 #ifndef __TASKS_H__
 #define __TASKS_H__
 
-void task_followTrajectory();
-void task_followLine();
-void task_searchLine();
-void task_avoidObstacle();
-void task_finishLine();
+#include "sensors.h"
+#include "odometry.h"
+
+typedef enum {FIRST_STRAIGHT, SECOND_STRAIGHT, THIRD_STRAIGHT, RIGHT_CURVE, LEFT_CURVE, FINISHED} YellowTrajectory;
+typedef enum {LEFT, RIGHT, CENTER, DRIVE_FORWARD} SearchLine;
+typedef enum {REVERSE, TURN, CIRCUIT} AvoidObstacle;
+typedef enum {SWEEP_LEFT, SWEEP_RIGHT, SWEEP_BACK} CalibrateLine;
+
+/* Progress within the tasks */
+typedef struct
+{
+	YellowTrajectory yellow_trajectory_state;
+	SearchLine search_line_state;
+	AvoidObstacle avoid_obstacle_state;
+	CalibrateLine calibrate_line_state;
+	uint8_t perimeter_checked;
+	int8_t obstacle_passed;
+	uint8_t calibration_saved;  /* Saving the calibration at the finish was attempted */
+	Pose segment_start;  /* Pose at the start of the current section of a manoeuvre */
+} Tasks;
+
+void task_followTrajectory(RobotContext* robot);
+void task_followLine(RobotContext* robot);
+void task_searchLine(RobotContext* robot);
+void task_avoidObstacle(RobotContext* robot);
+void task_finishLine(RobotContext* robot);
+void task_calibrateLine(RobotContext* robot, const SensorFrame* frame);
+void task_switch(RobotContext* robot, RaceState state);
 
 #endif /* __TASKS_H__ */
@@ -0,0 +1,35 @@
+/**
+ * @brief  Header file for telemetry.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include "main.h"
+#include "protocol.h"
+
+/* Size of the transmit ring in bytes (must be a power of two) */
+#define TELEMETRY_BUFFER_SIZE 1024
+
+/* Single-producer/single-consumer transmit ring */
+typedef struct
+{
+	uint8_t ring[TELEMETRY_BUFFER_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t tx_len;          /* Bytes handed to the DMA that are still in flight (0 if idle) */
+	volatile uint32_t dropped_frames;
+	volatile uint32_t high_water;
+	ProtocolStream stream;             /* Framing and delta encoding of the sent frames */
+	uint8_t enabled;                   /* The periodic samples and statistics are sent */
+} Telemetry;
+
+void telemetry_init(Telemetry* telemetry, uint8_t fields);
+uint32_t telemetry_free(const Telemetry* telemetry);
+uint8_t telemetry_write(Telemetry* telemetry, const uint8_t* data, uint32_t len);
+uint8_t telemetry_sendSample(Telemetry* telemetry, const ProtocolSample* sample);
+uint8_t telemetry_sendText(Telemetry* telemetry, const char* text, uint32_t len);
+
+#endif /* __TELEMETRY_H__ */
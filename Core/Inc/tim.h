@@ -28,16 +28,28 @@ extern "C" {
 #include "main.h"
 
 /* USER CODE BEGIN Includes */
+#include "velocity.h"
 
 /* USER CODE END Includes */
 
 extern TIM_HandleTypeDef htim1;
+extern TIM_HandleTypeDef htim2;
+extern TIM_HandleTypeDef htim6;
+extern TIM_HandleTypeDef htim7;
 
 /* USER CODE BEGIN Private defines */
+/* Clock of the APB1/APB2 timers */
+#define TIMER_CLOCK_HZ 32000000
+
+/* Rate at which TIM6 triggers a scan of all six ADC channels */
+#define ADC_SAMPLE_RATE_HZ 5000
 
 /* USER CODE END Private defines */
 
 void MX_TIM1_Init(void);
+void MX_TIM2_Init(void);
+void MX_TIM6_Init(void);
+void MX_TIM7_Init(void);
 
 void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim);
 
@@ -7,12 +7,18 @@
 #ifndef __UTILITY_H__
 #define __UTILITY_H__
 
-void blinkLeftLED();
-void blinkRightLED();
-void blinkTailLight();
-void blinkAllLEDs();
-void setNormalSpeed();
-void setMaxSpeed();
-void resetEncoderCnt();
+#include "sensors.h"
+
+typedef struct RobotContext RobotContext;
+
+void blinkLeftLED(RobotContext* robot);
+void blinkRightLED(RobotContext* robot);
+void blinkTailLight(RobotContext* robot);
+void blinkAllLEDs(RobotContext* robot);
+void setNormalSpeed(RobotContext* robot);
+void setMaxSpeed(RobotContext* robot);
+void resetEncoderCnt(RobotContext* robot);
+void updateEncoderCnt(RobotContext* robot, const SensorFrame* frame);
+uint32_t getMicros();
 
 #endif /* __UTILITY_H__ */
@@ -0,0 +1,58 @@
+/**
+ * @brief  Header file for velocity.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __VELOCITY_H__
+#define __VELOCITY_H__
+
+#include "fixedpoint.h"
+
+typedef struct RobotContext RobotContext;
+
+/* Rate at which TIM7 runs the wheel velocity controllers */
+#define VELOCITY_CONTROL_RATE_HZ 100
+
+/* Speed of a wheel at full PWM in mm/s, used for the feed-forward */
+#define MAX_WHEEL_VELOCITY 300
+
+/* Number of control periods the tick rate is measured over */
+#define VELOCITY_WINDOW 10
+
+/* Below this number of ticks within the window the velocity is taken from the edge interval */
+#define VELOCITY_COUNT_TICKS 4
+
+/* A wheel without an edge for this time in us is considered to stand still */
+#define VELOCITY_STOP_US 250000
+
+/* PI(D) velocity controller of one wheel, all values in Q16.16 */
+typedef struct
+{
+	q16_t kp;             /* Duty per mm/s of error */
+	q16_t ki;             /* Duty per mm of accumulated error */
+	q16_t kd;             /* Duty per mm/s^2 of error change */
+	q16_t kff;            /* Duty per mm/s of target velocity */
+	q16_t target;         /* Target velocity in mm/s */
+	q16_t measured;       /* Estimated velocity in mm/s, negative backwards */
+	q16_t integral;       /* Integrated error in mm */
+	q16_t previous_error; /* Error of the last step in mm/s */
+	q16_t output;         /* Duty cycle in [-1, 1] */
+	int8_t direction;     /* Sign of the latest ticks */
+} WheelController;
+
+/* State of the velocity control of both wheels, only written by the TIM7 interrupt */
+typedef struct
+{
+	WheelController left;
+	WheelController right;
+	int32_t ticks_left[VELOCITY_WINDOW];   /* Tick counts of the last control periods */
+	int32_t ticks_right[VELOCITY_WINDOW];
+	uint8_t window_index;
+} VelocityControl;
+
+void initVelocityControl(RobotContext* robot);
+void setWheelVelocity(RobotContext* robot, q16_t velocity_left, q16_t velocity_right);
+void velocityControlStep(RobotContext* robot);
+
+#endif /* __VELOCITY_H__ */
@@ -0,0 +1,442 @@
+/**
+ * @brief  Thresholds of the encoder Schmitt triggers that follow the signals of the encoders,
+ * 		   and the levels of the line sensors.
+ *
+ * The level of the stripes depends on the ambient light, the height of the sensors and the
+ * battery, so fixed thresholds miss or double-count ticks. The ADC interrupt therefore
+ * tracks the envelope of each encoder signal: the maximum of every dark half period and the
+ * minimum of every bright one, each averaged over the last 2^CALIBRATION_AVERAGE_SHIFT half
+ * periods. Once enough half periods were seen and the levels are far enough apart, the band
+ * of the Schmitt trigger is placed at a quarter of the swing inside the envelope. The half
+ * periods are delimited with the current thresholds, so the envelope only changes while
+ * the wheel turns and does not collapse when the robot stands still.
+ *
+ * The parameter encoder_calibration switches the adaptation off, e.g. to tune the thresholds
+ * by hand. The learned thresholds are kept in the last page of the flash, which the linker
+ * script keeps free, and are loaded at the start. They are saved at the finish and with the
+ * command "calibration save". Erasing the page stalls the CPU for about 25 ms, so it is only
+ * done while the robot stands.
+ *
+ * The line sensors differ in their raw values on the same floor, so each has its own white
+ * and black level. They are measured by a sweep over the line (task_calibrateLine()), which
+ * records the extremes of every sensor, and are saved together with the encoder thresholds.
+ * Every step converts the raw values into reflectances from 0 (black) to 1 (white) with a
+ * precomputed factor per sensor, which the tasks work on instead of the raw values.
+ *
+ * @author Lukas Probst
+ */
+
+#include <string.h>
+
+#include "main.h"
+#include "sensors.h"
+#include "protocol.h"
+#include "fmt.h"
+#include "telemetry.h"
+#include "calibration.h"
+#include "robot.h"
+
+/* Last page of the flash, not used by the program */
+#define CALIBRATION_PAGE    127
+#define CALIBRATION_ADDRESS (FLASH_BASE + CALIBRATION_PAGE * FLASH_PAGE_SIZE)
+
+/* Marks a valid record, the last byte is the version of its layout */
+#define CALIBRATION_MAGIC 0x43414C02
+
+/* Record of the learned values in the flash, a multiple of 8 bytes */
+typedef struct
+{
+	uint32_t magic;
+	uint16_t encoder_left_high;
+	uint16_t encoder_left_low;
+	uint16_t encoder_right_high;
+	uint16_t encoder_right_low;
+	uint16_t line_white[LINE_SENSORS];
+	uint16_t line_black[LINE_SENSORS];
+	uint16_t reserved[3];
+	uint16_t crc;               /* CRC-16 of all bytes before */
+} CalibrationRecord;
+
+/* Channel of each line sensor within a scan */
+static const uint8_t line_channels[LINE_SENSORS] =
+{
+	[LINE_LEFT]   = CH_LINESENSOR_LEFT,
+	[LINE_MIDDLE] = CH_LINESENSOR_MIDDLE,
+	[LINE_RIGHT]  = CH_LINESENSOR_RIGHT,
+};
+
+/**
+ * @brief  Adds the extreme of a completed half period to an average.
+ *
+ * @param  sum average scaled by 2^CALIBRATION_AVERAGE_SHIFT
+ * @param  extreme extreme of the half period
+ * @param  first the average has no values yet
+ * @return None
+ */
+static inline void addExtreme(int32_t* sum, uint16_t extreme, uint8_t first)
+{
+	if (first)
+	{
+		*sum = (int32_t) extreme << CALIBRATION_AVERAGE_SHIFT;
+	}
+	else
+	{
+		*sum += extreme - (*sum >> CALIBRATION_AVERAGE_SHIFT);
+	}
+}
+
+/**
+ * @brief  Tracks the envelope of an encoder signal and moves the thresholds into it.
+ *
+ * Called by the ADC interrupt for every filtered scan. The thresholds are written with single
+ * stores, like a change by a command.
+ *
+ * @param  envelope envelope of the encoder
+ * @param  value filtered sample of the encoder
+ * @param  low low threshold of the Schmitt trigger, updated
+ * @param  high high threshold of the Schmitt trigger, updated
+ * @param  enabled 0 to only track the envelope
+ * @return None
+ */
+void calibration_trackEncoder(EncoderEnvelope* envelope, uint16_t value, uint16_t* low, uint16_t* high, uint16_t enabled)
+{
+	if (envelope->state == HIGH)
+	{
+		if (value > envelope->extreme)
+		{
+			envelope->extreme = value;
+		}
+		if (value > *low)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if (value < envelope->extreme)
+		{
+			envelope->extreme = value;
+		}
+		if (value < *high)
+		{
+			return;
+		}
+	}
+
+	/* The first half period started anywhere, the next two start the averages */
+	uint16_t half_periods = envelope->half_periods;
+	if (half_periods > 0)
+	{
+		addExtreme(envelope->state == HIGH ? &envelope->high_sum : &envelope->low_sum, envelope->extreme, half_periods <= 2);
+	}
+	if (half_periods < UINT16_MAX)
+	{
+		envelope->half_periods = half_periods + 1;
+	}
+	envelope->state = envelope->state == HIGH ? LOW : HIGH;
+	envelope->extreme = value;
+
+	int32_t bright = envelope->low_sum >> CALIBRATION_AVERAGE_SHIFT;
+	int32_t dark = envelope->high_sum >> CALIBRATION_AVERAGE_SHIFT;
+	int32_t swing = dark - bright;
+	if (enabled && half_periods >= CALIBRATION_MIN_HALF_PERIODS && swing >= CALIBRATION_MIN_SWING)
+	{
+		*low = (uint16_t) (bright + swing / 4);
+		*high = (uint16_t) (dark - swing / 4);
+	}
+}
+
+/**
+ * @brief  Forgets the envelopes, e.g. after the sensors were moved.
+ *
+ * @param  calibration calibration of the robot
+ * @return None
+ */
+void calibration_reset(Calibration* calibration)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	memset(&calibration->left, 0, sizeof(calibration->left));
+	memset(&calibration->right, 0, sizeof(calibration->right));
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Sets the levels of a line sensor and the factor that normalises its values.
+ *
+ * @param  levels levels of the line sensor
+ * @param  white raw value on the white floor
+ * @param  black raw value on the line, above white
+ * @return None
+ */
+static void setLineLevels(LineLevels* levels, uint16_t white, uint16_t black)
+{
+	levels->white = white;
+	levels->black = black;
+	levels->scale = (Q16_ONE << CALIBRATION_LINE_SHIFT) / (black - white);
+}
+
+/**
+ * @brief  Sets the default levels of the line sensors and takes the values saved in the
+ * 		   flash, if there are any.
+ *
+ * @param  calibration calibration of the robot
+ * @param  params parameters of the robot, receive the encoder thresholds
+ * @return None
+ */
+void calibration_init(Calibration* calibration, Params* params)
+{
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		setLineLevels(&calibration->line[i], CALIBRATION_LINE_WHITE, CALIBRATION_LINE_BLACK);
+	}
+	calibration_startLineSweep(calibration);
+
+	const CalibrationRecord* record = (const CalibrationRecord*) CALIBRATION_ADDRESS;
+	if (record->magic != CALIBRATION_MAGIC
+			|| record->crc != protocol_crc16((const uint8_t*) record, offsetof(CalibrationRecord, crc)))
+	{
+		return;
+	}
+	params->encoder_left_high = record->encoder_left_high;
+	params->encoder_left_low = record->encoder_left_low;
+	params->encoder_right_high = record->encoder_right_high;
+	params->encoder_right_low = record->encoder_right_low;
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		if (record->line_black[i] >= record->line_white[i] + CALIBRATION_MIN_LINE_SWING)
+		{
+			setLineLevels(&calibration->line[i], record->line_white[i], record->line_black[i]);
+		}
+	}
+}
+
+/**
+ * @brief  Saves the current encoder thresholds and line sensor levels in the flash, unless
+ * 		   they are saved already.
+ *
+ * @param  calibration calibration of the robot
+ * @param  params parameters of the robot
+ * @return 1 if the flash holds the values, 0 if writing failed
+ */
+uint8_t calibration_save(const Calibration* calibration, const Params* params)
+{
+	CalibrationRecord record;
+	memset(&record, 0, sizeof(record));
+	record.magic = CALIBRATION_MAGIC;
+	record.encoder_left_high = params->encoder_left_high;
+	record.encoder_left_low = params->encoder_left_low;
+	record.encoder_right_high = params->encoder_right_high;
+	record.encoder_right_low = params->encoder_right_low;
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		record.line_white[i] = calibration->line[i].white;
+		record.line_black[i] = calibration->line[i].black;
+	}
+	record.crc = protocol_crc16((const uint8_t*) &record, offsetof(CalibrationRecord, crc));
+	if (memcmp(&record, (const void*) CALIBRATION_ADDRESS, sizeof(record)) == 0)
+	{
+		return 1;
+	}
+
+	FLASH_EraseInitTypeDef erase = {0};
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = FLASH_BANK_1;
+	erase.Page = CALIBRATION_PAGE;
+	erase.NbPages = 1;
+	uint32_t page_error;
+	uint8_t ok = 0;
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	if (HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK)
+	{
+		ok = 1;
+		for (uint32_t offset = 0; ok && offset < sizeof(record); offset += sizeof(uint64_t))
+		{
+			uint64_t data;
+			memcpy(&data, (const uint8_t*) &record + offset, sizeof(data));
+			ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, CALIBRATION_ADDRESS + offset, data) == HAL_OK;
+		}
+	}
+	HAL_FLASH_Lock();
+	return ok;
+}
+
+/**
+ * @brief  Starts a sweep over the line, which forgets the extremes of the last one.
+ *
+ * @param  calibration calibration of the robot
+ * @return None
+ */
+void calibration_startLineSweep(Calibration* calibration)
+{
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		calibration->line[i].sweep_min = UINT16_MAX;
+		calibration->line[i].sweep_max = 0;
+	}
+}
+
+/**
+ * @brief  Records the extremes of the line sensors during a sweep.
+ *
+ * @param  calibration calibration of the robot
+ * @param  frame snapshot of the sensors
+ * @return None
+ */
+void calibration_trackLine(Calibration* calibration, const SensorFrame* frame)
+{
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		LineLevels* levels = &calibration->line[i];
+		uint16_t value = frame->adc[line_channels[i]];
+		if (value < levels->sweep_min)
+		{
+			levels->sweep_min = value;
+		}
+		if (value > levels->sweep_max)
+		{
+			levels->sweep_max = value;
+		}
+	}
+}
+
+/**
+ * @brief  Takes the extremes of the sweep as levels of the line sensors, if every sensor saw
+ * 		   both the floor and the line.
+ *
+ * @param  calibration calibration of the robot
+ * @return 1 if the levels were taken, 0 if the old levels are kept
+ */
+uint8_t calibration_finishLineSweep(Calibration* calibration)
+{
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		const LineLevels* levels = &calibration->line[i];
+		if (levels->sweep_max < levels->sweep_min + CALIBRATION_MIN_LINE_SWING)
+		{
+			return 0;
+		}
+	}
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		LineLevels* levels = &calibration->line[i];
+		setLineLevels(levels, levels->sweep_min, levels->sweep_max);
+	}
+	return 1;
+}
+
+/**
+ * @brief  Converts the raw values of the line sensors into reflectances.
+ *
+ * @param  calibration calibration of the robot
+ * @param  frame snapshot of the sensors
+ * @param  reflectance reflectance of each sensor in [0, 1], 0 on the line and 1 on the floor
+ * @return None
+ */
+void calibration_lineReflectance(const Calibration* calibration, const SensorFrame* frame, q16_t* reflectance)
+{
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		const LineLevels* levels = &calibration->line[i];
+		int32_t value = ((int32_t) levels->black - frame->adc[line_channels[i]]) * levels->scale >> CALIBRATION_LINE_SHIFT;
+		reflectance[i] = value < 0 ? 0 : value > Q16_ONE ? Q16_ONE : value;
+	}
+}
+
+/**
+ * @brief  Smallest raw value that any line sensor reports below a reflectance, e.g. for the
+ * 		   threshold of an analog watchdog.
+ *
+ * @param  calibration calibration of the robot
+ * @param  level reflectance in [0, 1]
+ * @return raw value
+ */
+uint16_t calibration_lineBlack(const Calibration* calibration, q16_t level)
+{
+	uint16_t lowest = UINT16_MAX;
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		const LineLevels* levels = &calibration->line[i];
+		int32_t value = levels->black - (q16_mulInt(level, levels->black - levels->white) >> Q16_SHIFT) + 1;
+		if (value < lowest)
+		{
+			lowest = (uint16_t) value;
+		}
+	}
+	return lowest;
+}
+
+/**
+ * @brief  Appends the thresholds and the envelope of an encoder.
+ */
+static void appendEncoder(FmtBuffer* out, const char* name, const EncoderEnvelope* envelope, uint16_t low, uint16_t high)
+{
+	fmt_string(out, name);
+	fmt_char(out, ' ');
+	fmt_unsigned(out, low, 0);
+	fmt_char(out, '-');
+	fmt_unsigned(out, high, 0);
+	fmt_string(out, " envelope ");
+	fmt_unsigned(out, (uint32_t) (envelope->low_sum >> CALIBRATION_AVERAGE_SHIFT), 0);
+	fmt_char(out, '-');
+	fmt_unsigned(out, (uint32_t) (envelope->high_sum >> CALIBRATION_AVERAGE_SHIFT), 0);
+	fmt_string(out, " half periods ");
+	fmt_unsigned(out, envelope->half_periods, 0);
+}
+
+/**
+ * @brief  Appends the white or the black level of all line sensors, separated by slashes.
+ */
+static void appendLineLevels(FmtBuffer* out, const LineLevels* line, uint8_t black)
+{
+	for (uint32_t i = 0; i < LINE_SENSORS; i++)
+	{
+		if (i > 0)
+		{
+			fmt_char(out, '/');
+		}
+		fmt_unsigned(out, black ? line[i].black : line[i].white, 0);
+	}
+}
+
+/**
+ * @brief  Sends the thresholds and the envelopes of the encoders and the levels of the line
+ * 		   sensors as text frames, once every CALIBRATION_REPORT_INTERVAL calls.
+ *
+ * Line format: "# calibration left <low>-<high> envelope <bright>-<dark> half periods <n>, right ..."
+ * followed by "# calibration line white <left>/<middle>/<right> black <left>/<middle>/<right>"
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void calibration_report(RobotContext* robot)
+{
+	Calibration* calibration = &robot->calibration;
+	if (++calibration->report_counter < CALIBRATION_REPORT_INTERVAL)
+	{
+		return;
+	}
+	calibration->report_counter = 0;
+
+	char string_buf[128];
+	FmtBuffer out;
+
+	/* One character stays free for the newline */
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+	fmt_string(&out, "# calibration ");
+	appendEncoder(&out, "left", &calibration->left, robot->params.encoder_left_low, robot->params.encoder_left_high);
+	fmt_string(&out, ", ");
+	appendEncoder(&out, "right", &calibration->right, robot->params.encoder_right_low, robot->params.encoder_right_high);
+	string_buf[out.len++] = '\n';
+	telemetry_sendText(&robot->telemetry, string_buf, out.len);
+
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+	fmt_string(&out, "# calibration line white ");
+	appendLineLevels(&out, calibration->line, 0);
+	fmt_string(&out, " black ");
+	appendLineLevels(&out, calibration->line, 1);
+	string_buf[out.len++] = '\n';
+	telemetry_sendText(&robot->telemetry, string_buf, out.len);
+}
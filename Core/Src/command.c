@@ -0,0 +1,585 @@
+/**
+ * @brief  Command interface on USART2 for tuning the robot while it is running.
+ *
+ * The DMA receives into a circular buffer, and the reception events of the HAL (half,
+ * complete and idle line) only record the position of the DMA. The lines are parsed and
+ * executed by command_poll() in the main context, so a command never delays the interrupts
+ * of the control loop. Replies are sent as text frames of the telemetry.
+ *
+ * Commands, one per line:
+ *   get <name>              value of a parameter of the registry in params.c
+ *   set <name> <value>      changes a parameter, e.g. "set line_gain 160"
+ *   list                    all parameters with their ranges, one per poll
+ *   state [<name>]          current task, or switches to a task, e.g. "state follow_line"
+ *   telemetry on|off        starts or stops the periodic telemetry
+ *   profile [reset]         requests a report of the profiler or resets it
+ *   recorder [arm|trigger|dump]
+ *                           state of the flight recorder, rearms, triggers or dumps it
+ *   calibration [save|reset]
+ *                           encoder thresholds, saves them and the line sensor levels in the
+ *                           flash or restarts learning
+ *
+ * Replies start with "ok" or "error".
+ *
+ * @author Lukas Probst
+ */
+
+#include <string.h>
+
+#include "usart.h"
+#include "fmt.h"
+#include "params.h"
+#include "tasks.h"
+#include "telemetry.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "calibration.h"
+#include "command.h"
+#include "robot.h"
+
+/* Words of a command line that are evaluated */
+#define MAX_TOKENS 3
+
+/* Longest reply */
+#define MAX_REPLY 96
+
+static const char* const state_names[] =
+{
+	[FOLLOW_TRAJECTORY] = "follow_trajectory",
+	[FOLLOW_LINE]       = "follow_line",
+	[SEARCH_LINE]       = "search_line",
+	[AVOID_OBSTACLE]    = "avoid_obstacle",
+	[FINISH_LINE]       = "finish_line",
+	[CALIBRATE_LINE]    = "calibrate_line",
+};
+
+#define STATE_COUNT (sizeof(state_names) / sizeof(state_names[0]))
+
+static const char* const trigger_names[] =
+{
+	[RECORDER_NONE]      = "recording",
+	[RECORDER_LINE_LOST] = "line_lost",
+	[RECORDER_FINISH]    = "finish",
+	[RECORDER_ERROR]     = "error",
+	[RECORDER_COMMAND]   = "command",
+};
+
+/* Word of a command line, not terminated */
+typedef struct
+{
+	const char* text;
+	uint32_t len;
+} Token;
+
+/**
+ * @brief  Starts the reception from the beginning of the buffer.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+static void startReception(RobotContext* robot)
+{
+	Command* command = &robot->command;
+	command->rx_head = 0;
+	command->rx_tail = 0;
+	command->line_len = 0;
+	command->line_overflow = 0;
+	command->rx_stopped = 0;
+	HAL_UARTEx_ReceiveToIdle_DMA(&huart2, command->rx, COMMAND_RX_SIZE);
+}
+
+/**
+ * @brief  Starts the reception of commands.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void command_init(RobotContext* robot)
+{
+	robot->command.list_index = -1;
+	startReception(robot);
+}
+
+/**
+ * @brief  Notes that the HAL stopped the reception after an error, command_poll() restarts it.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void command_receptionStopped(RobotContext* robot)
+{
+	robot->command.rx_stopped = 1;
+}
+
+/**
+ * @brief  Called by the HAL on the half and complete events of the DMA and when the line
+ * 		   goes idle after a burst of bytes.
+ *
+ * @param  huart UART handle structure
+ * @param  size position of the DMA in the receive buffer
+ * @return None
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t size)
+{
+	if (huart->Instance == USART2)
+	{
+		robot_active->command.rx_head = size % COMMAND_RX_SIZE;
+	}
+}
+
+static uint8_t tokenIs(const Token* token, const char* word)
+{
+	return strncmp(token->text, word, token->len) == 0 && word[token->len] == '\0';
+}
+
+/**
+ * @brief  Parses a decimal number like "-0.045" into an integer in units of 10^-decimals.
+ *
+ * Digits beyond the decimal places are cut off.
+ *
+ * @param  token text of the number
+ * @param  decimals decimal places of the result
+ * @param  value receives the number
+ * @return 1 if the text is a number, 0 if not or if it does not fit
+ */
+static uint8_t parseFixed(const Token* token, uint8_t decimals, int32_t* value)
+{
+	const char* p = token->text;
+	const char* end = token->text + token->len;
+	uint8_t negative = 0;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p++ == '-';
+	}
+
+	int64_t result = 0;
+	uint32_t digits = 0;
+	int32_t fraction_digits = -1;
+	for (; p < end; p++)
+	{
+		if (*p == '.' && fraction_digits < 0)
+		{
+			fraction_digits = 0;
+			continue;
+		}
+		if (*p < '0' || *p > '9')
+		{
+			return 0;
+		}
+		if (fraction_digits >= decimals)
+		{
+			continue;
+		}
+		result = result * 10 + (*p - '0');
+		digits++;
+		if (fraction_digits >= 0)
+		{
+			fraction_digits++;
+		}
+		if (result > INT32_MAX)
+		{
+			return 0;
+		}
+	}
+
+	for (int32_t i = fraction_digits < 0 ? 0 : fraction_digits; i < decimals; i++)
+	{
+		result *= 10;
+		if (result > INT32_MAX)
+		{
+			return 0;
+		}
+	}
+
+	*value = (int32_t) (negative ? -result : result);
+	return digits > 0;
+}
+
+/**
+ * @brief  Sends a reply, the text is finished with a newline.
+ *
+ * @param  robot state of the robot
+ * @param  out reply with one character left free
+ * @return 1 if the reply was queued, 0 if the telemetry ring was full
+ */
+static uint8_t reply(RobotContext* robot, FmtBuffer* out)
+{
+	out->data[out->len++] = '\n';
+	return telemetry_sendText(&robot->telemetry, out->data, out->len);
+}
+
+/**
+ * @brief  Sends "error <message>".
+ */
+static void replyError(RobotContext* robot, const char* message)
+{
+	char string_buf[MAX_REPLY];
+	FmtBuffer out;
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+	fmt_string(&out, "error ");
+	fmt_string(&out, message);
+	reply(robot, &out);
+}
+
+/**
+ * @brief  Appends the valid range of a parameter as " [min, max]".
+ */
+static void appendRange(FmtBuffer* out, const ParamInfo* info)
+{
+	uint8_t decimals = params_decimals(info->type);
+	fmt_string(out, " [");
+	fmt_fixed(out, info->min, decimals);
+	fmt_string(out, ", ");
+	fmt_fixed(out, info->max, decimals);
+	fmt_char(out, ']');
+}
+
+/**
+ * @brief  Sends "ok <name> <value>" for a parameter, with its range if requested.
+ */
+static uint8_t replyParam(RobotContext* robot, const ParamInfo* info, uint8_t with_range)
+{
+	char string_buf[MAX_REPLY];
+	FmtBuffer out;
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+	fmt_string(&out, "ok ");
+	fmt_string(&out, info->name);
+	fmt_char(&out, ' ');
+	fmt_fixed(&out, params_get(&robot->params, info), params_decimals(info->type));
+	if (with_range)
+	{
+		appendRange(&out, info);
+	}
+	return reply(robot, &out);
+}
+
+/**
+ * @brief  Sends "ok <word> <word>".
+ */
+static void replyWords(RobotContext* robot, const char* first, const char* second)
+{
+	char string_buf[MAX_REPLY];
+	FmtBuffer out;
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+	fmt_string(&out, "ok ");
+	fmt_string(&out, first);
+	fmt_char(&out, ' ');
+	fmt_string(&out, second);
+	reply(robot, &out);
+}
+
+/**
+ * @brief  Handles "get" and "set".
+ */
+static void accessParam(RobotContext* robot, const Token* tokens, uint32_t count)
+{
+	uint8_t set = tokenIs(&tokens[0], "set");
+	if (count != (set ? 3u : 2u))
+	{
+		replyError(robot, set ? "usage: set <name> <value>" : "usage: get <name>");
+		return;
+	}
+
+	const ParamInfo* info = params_find(tokens[1].text, tokens[1].len);
+	if (info == NULL)
+	{
+		replyError(robot, "unknown parameter");
+		return;
+	}
+
+	if (set)
+	{
+		int32_t value;
+		if (!parseFixed(&tokens[2], params_decimals(info->type), &value))
+		{
+			replyError(robot, "invalid value");
+			return;
+		}
+		if (!params_set(&robot->params, info, value))
+		{
+			char string_buf[MAX_REPLY];
+			FmtBuffer out;
+			fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+			fmt_string(&out, "error out of range");
+			appendRange(&out, info);
+			reply(robot, &out);
+			return;
+		}
+	}
+	replyParam(robot, info, 0);
+}
+
+/**
+ * @brief  Handles "state".
+ */
+static void switchState(RobotContext* robot, const Token* tokens, uint32_t count)
+{
+	if (count == 2)
+	{
+		uint32_t state = 0;
+		while (state < STATE_COUNT && !tokenIs(&tokens[1], state_names[state]))
+		{
+			state++;
+		}
+		if (state == STATE_COUNT)
+		{
+			replyError(robot, "unknown state");
+			return;
+		}
+		task_switch(robot, (RaceState) state);
+	}
+	else if (count != 1)
+	{
+		replyError(robot, "usage: state [<name>]");
+		return;
+	}
+	replyWords(robot, "state", state_names[robot->current_state]);
+}
+
+/**
+ * @brief  Handles "telemetry".
+ */
+static void switchTelemetry(RobotContext* robot, const Token* tokens, uint32_t count)
+{
+	if (count == 2 && (tokenIs(&tokens[1], "on") || tokenIs(&tokens[1], "off")))
+	{
+		robot->telemetry.enabled = tokenIs(&tokens[1], "on");
+	}
+	else if (count != 1)
+	{
+		replyError(robot, "usage: telemetry [on|off]");
+		return;
+	}
+	replyWords(robot, "telemetry", robot->telemetry.enabled ? "on" : "off");
+}
+
+/**
+ * @brief  Handles "profile".
+ */
+static void profile(RobotContext* robot, const Token* tokens, uint32_t count)
+{
+#ifdef PROFILING
+	if (count == 2 && tokenIs(&tokens[1], "reset"))
+	{
+		profiler_reset();
+		replyWords(robot, "profile", "reset");
+	}
+	else if (count == 1)
+	{
+		profiler_requestReport();
+		replyWords(robot, "profile", "requested");
+	}
+	else
+	{
+		replyError(robot, "usage: profile [reset]");
+	}
+#else
+	(void) tokens;
+	(void) count;
+	replyError(robot, "profiling disabled");
+#endif
+}
+
+/**
+ * @brief  Handles "recorder".
+ */
+static void controlRecorder(RobotContext* robot, const Token* tokens, uint32_t count)
+{
+	char string_buf[MAX_REPLY];
+	FmtBuffer out;
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+
+	if (count == 2 && tokenIs(&tokens[1], "dump"))
+	{
+		uint32_t records = recorder_startDump(&robot->recorder);
+		fmt_string(&out, "ok recorder dump ");
+		fmt_unsigned(&out, records, 0);
+		reply(robot, &out);
+		return;
+	}
+	if (count == 2 && tokenIs(&tokens[1], "arm"))
+	{
+		recorder_arm(&robot->recorder);
+	}
+	else if (count == 2 && tokenIs(&tokens[1], "trigger"))
+	{
+		recorder_trigger(&robot->recorder, RECORDER_COMMAND);
+	}
+	else if (count != 1)
+	{
+		replyError(robot, "usage: recorder [arm|trigger|dump]");
+		return;
+	}
+
+	fmt_string(&out, "ok recorder ");
+	fmt_string(&out, trigger_names[robot->recorder.trigger]);
+	fmt_string(&out, robot->recorder.frozen ? " frozen " : " ");
+	fmt_unsigned(&out, robot->recorder.count, 0);
+	reply(robot, &out);
+}
+
+/**
+ * @brief  Handles "calibration".
+ */
+static void controlCalibration(RobotContext* robot, const Token* tokens, uint32_t count)
+{
+	if (count == 2 && tokenIs(&tokens[1], "save"))
+	{
+		/* Erasing the flash stalls the control loop, so only a standing robot saves */
+		if (robot->velocity.left.measured != 0 || robot->velocity.right.measured != 0)
+		{
+			replyError(robot, "robot is moving");
+			return;
+		}
+		if (!calibration_save(&robot->calibration, &robot->params))
+		{
+			replyError(robot, "flash write failed");
+			return;
+		}
+	}
+	else if (count == 2 && tokenIs(&tokens[1], "reset"))
+	{
+		calibration_reset(&robot->calibration);
+	}
+	else if (count != 1)
+	{
+		replyError(robot, "usage: calibration [save|reset]");
+		return;
+	}
+
+	char string_buf[MAX_REPLY];
+	FmtBuffer out;
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+	fmt_string(&out, "ok calibration left ");
+	fmt_unsigned(&out, robot->params.encoder_left_low, 0);
+	fmt_char(&out, '-');
+	fmt_unsigned(&out, robot->params.encoder_left_high, 0);
+	fmt_string(&out, ", right ");
+	fmt_unsigned(&out, robot->params.encoder_right_low, 0);
+	fmt_char(&out, '-');
+	fmt_unsigned(&out, robot->params.encoder_right_high, 0);
+	fmt_string(&out, robot->params.encoder_calibration ? " learning" : " fixed");
+	reply(robot, &out);
+}
+
+/**
+ * @brief  Splits a line into words and executes it.
+ *
+ * @param  robot state of the robot
+ * @param  line characters of the line without the newline
+ * @param  len number of characters
+ * @return None
+ */
+static void execute(RobotContext* robot, const char* line, uint32_t len)
+{
+	Token tokens[MAX_TOKENS + 1];
+	uint32_t count = 0;
+	uint32_t i = 0;
+	while (i < len && count <= MAX_TOKENS)
+	{
+		while (i < len && line[i] == ' ')
+		{
+			i++;
+		}
+		if (i == len)
+		{
+			break;
+		}
+		tokens[count].text = &line[i];
+		while (i < len && line[i] != ' ')
+		{
+			i++;
+		}
+		tokens[count].len = &line[i] - tokens[count].text;
+		count++;
+	}
+
+	if (count == 0)
+	{
+		return;
+	}
+	if (tokenIs(&tokens[0], "get") || tokenIs(&tokens[0], "set"))
+	{
+		accessParam(robot, tokens, count);
+	}
+	else if (tokenIs(&tokens[0], "list") && count == 1)
+	{
+		robot->command.list_index = 0;
+	}
+	else if (tokenIs(&tokens[0], "state"))
+	{
+		switchState(robot, tokens, count);
+	}
+	else if (tokenIs(&tokens[0], "telemetry"))
+	{
+		switchTelemetry(robot, tokens, count);
+	}
+	else if (tokenIs(&tokens[0], "profile"))
+	{
+		profile(robot, tokens, count);
+	}
+	else if (tokenIs(&tokens[0], "recorder"))
+	{
+		controlRecorder(robot, tokens, count);
+	}
+	else if (tokenIs(&tokens[0], "calibration"))
+	{
+		controlCalibration(robot, tokens, count);
+	}
+	else
+	{
+		replyError(robot, "unknown command");
+	}
+}
+
+/**
+ * @brief  Executes the received command lines and continues a pending "list" or dump of the
+ * 		   flight recorder.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void command_poll(RobotContext* robot)
+{
+	Command* command = &robot->command;
+	if (command->rx_stopped)
+	{
+		startReception(robot);
+	}
+
+	/* A line that does not fit into the telemetry ring is sent again on the next call */
+	if (command->list_index >= 0 && replyParam(robot, &param_registry[command->list_index], 1))
+	{
+		command->list_index++;
+		if ((uint32_t) command->list_index == param_count)
+		{
+			command->list_index = -1;
+		}
+	}
+	recorder_poll(robot);
+
+	uint32_t head = command->rx_head;
+	while (command->rx_tail != head)
+	{
+		char c = (char) command->rx[command->rx_tail];
+		command->rx_tail = (command->rx_tail + 1) % COMMAND_RX_SIZE;
+
+		if (c == '\n' || c == '\r')
+		{
+			if (!command->line_overflow)
+			{
+				execute(robot, command->line, command->line_len);
+			}
+			command->line_len = 0;
+			command->line_overflow = 0;
+		}
+		else if (command->line_len < COMMAND_MAX_LINE)
+		{
+			command->line[command->line_len++] = c;
+		}
+		else
+		{
+			command->line_overflow = 1;
+		}
+	}
+}
@@ -4,38 +4,59 @@
  * @author Lukas Probst
  */
 
-#include <math.h>
-
 #include "adc.h"
 #include "utility.h"
 #include "sensors.h"
 #include "driving.h"
+#include "velocity.h"
+#include "robot.h"
 
 /* Maximum motor speed or rather PWM-value of the robot */
-#define MAX_PWM (int) (pow(2, 16) - 1)
+#define MAX_PWM 65535
+
+/**
+ * @brief  Converts a speed into the compare value of the PWM timer.
+ *
+ * @param  speed speed in the interval [-1, 1]
+ * @return PWM value for the magnitude of the speed
+ */
+static uint32_t speedToPwm(q16_t speed)
+{
+	if (speed < 0)
+	{
+		speed = -speed;
+	}
+	return q16_scale(speed, MAX_PWM);
+}
 
 /**
  * @brief  Sets the robot in motion by specifying a value for both wheels that
  * 		   lies in the interval [-1, 1].
  *
+ * Values outside of the interval are saturated.
+ *
+ * @param  robot state of the robot
  * @param  speed_left controls how fast and in which direction the left wheel turns
  * @param  speed_right controls how fast and in which direction the right wheel turns
  * @return None
  */
-void drive(double speed_left, double speed_right)
+void drive(RobotContext* robot, q16_t speed_left, q16_t speed_right)
 {
+	speed_left = q16_saturate(speed_left, -Q16_ONE, Q16_ONE);
+	speed_right = q16_saturate(speed_right, -Q16_ONE, Q16_ONE);
+
 	/* Left control */
 	if(speed_left > 0)
 	{
-		TIM1->CCR2 = (int) (MAX_PWM * speed_left);
+		TIM1->CCR2 = speedToPwm(speed_left);
 		HAL_GPIO_WritePin(GPIOA, phase2_L_Pin, GPIO_PIN_RESET);
-		blinkRightLED();
+		blinkRightLED(robot);
 	}
 	else if (speed_left < 0)
 	{
-		TIM1->CCR2 = (int) (MAX_PWM - MAX_PWM * speed_left);
+		TIM1->CCR2 = speedToPwm(speed_left);
 		HAL_GPIO_WritePin(GPIOA, phase2_L_Pin, GPIO_PIN_SET);
-		blinkLeftLED();
+		blinkLeftLED(robot);
 	}
 	else if (speed_left == 0)
 	{
@@ -47,15 +68,15 @@ void drive(double speed_left, double speed_right)
 	/* Right control */
 	if(speed_right > 0)
 	{
-		TIM1->CCR3 = (int) (MAX_PWM * speed_right);
+		TIM1->CCR3 = speedToPwm(speed_right);
 		HAL_GPIO_WritePin(GPIOB, phase2_R_Pin, GPIO_PIN_RESET);
-		blinkLeftLED();
+		blinkLeftLED(robot);
 	}
 	else if (speed_right < 0)
 	{
-		TIM1->CCR3 = (int) (MAX_PWM - MAX_PWM * speed_right);
+		TIM1->CCR3 = speedToPwm(speed_right);
 		HAL_GPIO_WritePin(GPIOB, phase2_R_Pin, GPIO_PIN_SET);
-		blinkRightLED();
+		blinkRightLED(robot);
 	}
 	else if (speed_right == 0)
 	{
@@ -69,6 +90,9 @@ void drive(double speed_left, double speed_right)
  * @brief  The two wheels of the robot do not always turn at the same speed. This function
  * 		   makes sure that the robot follows a straight line.
  *
+ * The velocity controllers already keep each wheel at its target velocity, this additionally
+ * corrects the position difference that builds up between the wheels.
+ *
  * The reasons for this are scatter in the manufacture of the motors or dirty gears. Therefore, the
  * wheels do not rotate at the same speed with the same control. In order to follow a defined path
  * (e.g. a straight line), the actual wheel rotations must be observed and the motor control adjusted
@@ -77,14 +101,15 @@ void drive(double speed_left, double speed_right)
  * the deviation of the setpoint from the actual value. To make the robot drive straight, a position
  * controller is suitable, which looks at the position of both wheels at the same time.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void driveForward()
+void driveForward(RobotContext* robot)
 {
-	float proportional_gain = 0.15f;
-	int32_t error = encoder_left_cnt - encoder_right_cnt;
-	double delta_speed_left = error * proportional_gain * speed_left;
-	double delta_speed_right = error * proportional_gain * speed_right;
+	int32_t error = robot->encoder_left_cnt - robot->encoder_right_cnt;
+	q16_t correction = q16_mulInt(robot->params.straight_gain, error);
+	q16_t delta_speed_left = q16_mul(correction, robot->speed_left);
+	q16_t delta_speed_right = q16_mul(correction, robot->speed_right);
 
-	drive(speed_left - delta_speed_left, speed_right + delta_speed_right);
+	setWheelVelocity(robot, q16_sub(robot->speed_left, delta_speed_left), q16_add(robot->speed_right, delta_speed_right));
 }
@@ -0,0 +1,170 @@
+/**
+ * @brief  Encoder ticks counted in hardware by the comparators and the low-power timers.
+ *
+ * Alternative to SchmittTrigger(), selected by defining ENCODER_COMPARATORS. Each encoder
+ * signal is compared by a comparator against a DAC channel, which is only connected to the
+ * comparators and not to its pin. The threshold is the middle of the band of the Schmitt
+ * trigger parameters, the comparators add their largest hysteresis. Every edge of a comparator
+ * output counts one step of an LPTIM, behind a digital filter of 8 LSI periods (about 250 us)
+ * that swallows the chatter of a slow edge. No edge is lost however late the CPU reads the
+ * counters, it only has to read them before 65536 edges have passed.
+ *
+ *   left encoder:  PA1 -> COMP1 (+), DAC1 channel 1 (-) -> LPTIM1 IN1
+ *   right encoder: PB6 -> COMP2 (+), DAC1 channel 2 (-) -> LPTIM2 IN1
+ *
+ * The right encoder is on PA5, which COMP2 can only use as its inverting input. Its signal
+ * must therefore also be bridged to PB6 on the board (free pin, analog mode).
+ *
+ * The HAL drivers of these peripherals are not part of the project, so they are configured
+ * through their registers. The ADC keeps sampling both encoder channels for the telemetry.
+ *
+ * @author Lukas Probst
+ */
+
+#ifdef ENCODER_COMPARATORS
+
+#include "main.h"
+#include "sensors.h"
+#include "encoder.h"
+#include "robot.h"
+
+/* Values of the comparator registers */
+#define COMP_INM_DAC1_CH1 (COMP_CSR_INMSEL_2)
+#define COMP_INM_DAC1_CH2 (COMP_CSR_INMSEL_2 | COMP_CSR_INMSEL_0)
+#define COMP1_INP_PA1     (COMP_CSR_INPSEL_1)
+#define COMP2_INP_PB6     (COMP_CSR_INPSEL_0)
+#define COMP_HYST_HIGH    (COMP_CSR_HYST_0 | COMP_CSR_HYST_1)
+
+/**
+ * @brief  Middle of the band of the Schmitt trigger, as DAC value.
+ */
+static inline uint32_t threshold(uint16_t low, uint16_t high)
+{
+	return ((uint32_t) low + high) / 2;
+}
+
+/**
+ * @brief  Sets up an LPTIM that counts both edges of the comparator on its input 1.
+ *
+ * @param  lptim timer
+ * @return None
+ */
+static void initCounter(LPTIM_TypeDef* lptim)
+{
+	/* Kernel clock for the filter, count on both edges of the external input */
+	lptim->CFGR = LPTIM_CFGR_COUNTMODE | LPTIM_CFGR_CKPOL_1 | LPTIM_CFGR_CKFLT_0 | LPTIM_CFGR_CKFLT_1;
+
+	/* Input 1 is the output of COMP1 (LPTIM1) or COMP2 (LPTIM2) */
+	lptim->OR = LPTIM_OR_OR_0;
+
+	/* The auto-reload register can only be written while the timer is enabled */
+	lptim->CR = LPTIM_CR_ENABLE;
+	lptim->ARR = 0xFFFF;
+	while ((lptim->ISR & LPTIM_ISR_ARROK) == 0)
+	{
+	}
+	lptim->ICR = LPTIM_ICR_ARROKCF;
+	lptim->CR = LPTIM_CR_ENABLE | LPTIM_CR_CNTSTRT;
+}
+
+/**
+ * @brief  Reads the counter of an LPTIM.
+ *
+ * The counter runs on the asynchronous kernel clock, so it is only valid if two consecutive
+ * reads agree.
+ *
+ * @param  lptim timer
+ * @return counter value
+ */
+static uint16_t readCounter(LPTIM_TypeDef* lptim)
+{
+	uint32_t first, second;
+	do
+	{
+		first = lptim->CNT;
+		second = lptim->CNT;
+	}
+	while (first != second);
+	return (uint16_t) first;
+}
+
+/**
+ * @brief  Starts the counting of the encoder edges by the comparators and the LPTIMs.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void encoder_init(RobotContext* robot)
+{
+	Sensors* sensors = &robot->sensors;
+
+	/* The LSI clocks the filters of the LPTIMs */
+	RCC->CSR |= RCC_CSR_LSION;
+	while ((RCC->CSR & RCC_CSR_LSIRDY) == 0)
+	{
+	}
+	MODIFY_REG(RCC->CCIPR, RCC_CCIPR_LPTIM1SEL | RCC_CCIPR_LPTIM2SEL, RCC_CCIPR_LPTIM1SEL_0 | RCC_CCIPR_LPTIM2SEL_0);
+
+	/* The comparators are clocked with SYSCFG */
+	RCC->APB1ENR1 |= RCC_APB1ENR1_DAC1EN | RCC_APB1ENR1_LPTIM1EN;
+	RCC->APB1ENR2 |= RCC_APB1ENR2_LPTIM2EN;
+	RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+	(void) RCC->APB2ENR;
+
+	/* Second input of the right encoder */
+	GPIOB->MODER |= GPIO_MODER_MODE6;
+
+	/* Both DAC channels only drive the comparators, PA4 and PA5 stay with the ADC */
+	DAC1->MCR = DAC_MCR_MODE1_0 | DAC_MCR_MODE1_1 | DAC_MCR_MODE2_0 | DAC_MCR_MODE2_1;
+	DAC1->DHR12R1 = threshold(robot->params.encoder_left_low, robot->params.encoder_left_high);
+	DAC1->DHR12R2 = threshold(robot->params.encoder_right_low, robot->params.encoder_right_high);
+	DAC1->CR = DAC_CR_EN1 | DAC_CR_EN2;
+
+	COMP1->CSR = COMP1_INP_PA1 | COMP_INM_DAC1_CH1 | COMP_HYST_HIGH | COMP_CSR_EN;
+	COMP2->CSR = COMP2_INP_PB6 | COMP_INM_DAC1_CH2 | COMP_HYST_HIGH | COMP_CSR_EN;
+
+	initCounter(LPTIM1);
+	initCounter(LPTIM2);
+	sensors->counter_left = readCounter(LPTIM1);
+	sensors->counter_right = readCounter(LPTIM2);
+}
+
+/**
+ * @brief  Adds the edges the LPTIMs counted since the last call to the encoder ticks.
+ *
+ * Like SchmittTrigger(), every edge counts one tick in the commanded direction of the wheel.
+ * The counters carry no time, so new edges are stamped with the time of the ADC block, which
+ * is 800 us coarser than the scans. The thresholds follow changes of the parameters.
+ *
+ * @param  robot state of the robot
+ * @param  timestamp time of the ADC block in us
+ * @return None
+ */
+void encoder_update(RobotContext* robot, uint32_t timestamp)
+{
+	Sensors* sensors = &robot->sensors;
+	uint16_t left = readCounter(LPTIM1);
+	uint16_t right = readCounter(LPTIM2);
+
+	/* The counters wrap around at 16 bits */
+	uint16_t edges_left = left - sensors->counter_left;
+	uint16_t edges_right = right - sensors->counter_right;
+	sensors->counter_left = left;
+	sensors->counter_right = right;
+	if (edges_left != 0)
+	{
+		recordEncoderEdge(&sensors->edge_left_timestamp, &sensors->edge_left_interval, &sensors->edge_left_seen, timestamp);
+	}
+	if (edges_right != 0)
+	{
+		recordEncoderEdge(&sensors->edge_right_timestamp, &sensors->edge_right_interval, &sensors->edge_right_seen, timestamp);
+	}
+
+	sensors->encoder_left_ticks += (phase2_L_GPIO_Port->ODR & phase2_L_Pin) ? -(int32_t) edges_left : edges_left;
+	sensors->encoder_right_ticks += (phase2_R_GPIO_Port->ODR & phase2_R_Pin) ? -(int32_t) edges_right : edges_right;
+
+	DAC1->DHR12R1 = threshold(robot->params.encoder_left_low, robot->params.encoder_left_high);
+	DAC1->DHR12R2 = threshold(robot->params.encoder_right_low, robot->params.encoder_right_high);
+}
+
+#endif /* ENCODER_COMPARATORS */
@@ -0,0 +1,258 @@
+/**
+ * @brief  Threshold crossings of the encoders and line sensors detected by the analog watchdogs
+ * 		   of the ADC.
+ *
+ * Alternative to SchmittTrigger(), selected by defining ADC_WATCHDOGS. Instead of comparing
+ * every scan in software, the ADC compares every conversion against a window and interrupts
+ * only when a value leaves it:
+ *
+ *   AWD1: left encoder (channel 6), above the high threshold while low and vice versa
+ *   AWD2: right encoder (channel 10), the same
+ *   AWD3: all three line sensors (channels 5, 8 and 12), above the black threshold
+ *
+ * After an encoder crossing the interrupt moves the window to the other side of the band, so
+ * the watchdog implements the Schmitt trigger. The thresholds may be changed while the ADC
+ * converts, a conversion running at that moment is just not compared. Every crossing is
+ * queued with its time, the ADC DMA interrupt counts the ticks from the queue instead of
+ * scanning the four frames of each block.
+ *
+ * One threshold pair covers all line sensors, so AWD3 fires at the lowest raw value any of
+ * them reports as black and can only report the first sensor that sees black. detectColour()
+ * skips its comparisons as long as that has not happened and arms the watchdog again when all
+ * sensors are white.
+ *
+ * With oversampling the watchdogs compare bits 15:4 of the data register, i.e. the upper 8
+ * bits of the 12-bit values for AWD1 and only the upper 4 bits for AWD2 and AWD3. The
+ * thresholds are rounded into the band, so a crossing is rather reported early than missed.
+ *
+ * @author Lukas Probst
+ */
+
+#ifdef ADC_WATCHDOGS
+
+#include "main.h"
+#include "adc.h"
+#include "sensors.h"
+#include "events.h"
+#include "utility.h"
+#include "robot.h"
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+/* Bits of a 12-bit value the watchdogs ignore with oversampling */
+#define AWD1_SHIFT  4
+#define AWD23_SHIFT 8
+
+/* Largest value of the threshold registers, a window up to it never fires on that side */
+#define AWD1_MAX  0xFFF
+#define AWD23_MAX 0xFF
+
+/**
+ * @brief  Register value above which a watchdog fires for values from level upwards.
+ */
+static inline uint32_t aboveThreshold(uint16_t level, uint32_t shift)
+{
+	uint32_t value = level >> shift;
+	return value > 0 ? value - 1 : 0;
+}
+
+/**
+ * @brief  Register value below which a watchdog fires for values from level downwards.
+ */
+static inline uint32_t belowThreshold(uint16_t level, uint32_t shift)
+{
+	return (level >> shift) + 1;
+}
+
+/**
+ * @brief  Sets the window of an encoder watchdog to the side of the band the signal is not on.
+ *
+ * @param  awd watchdog (LL_ADC_AWD1 or LL_ADC_AWD2)
+ * @param  state current level of the Schmitt trigger
+ * @param  low low threshold
+ * @param  high high threshold
+ * @return None
+ */
+static void setEncoderWindow(uint32_t awd, Threshold state, uint16_t low, uint16_t high)
+{
+	uint32_t shift = awd == LL_ADC_AWD1 ? AWD1_SHIFT : AWD23_SHIFT;
+	uint32_t max = awd == LL_ADC_AWD1 ? AWD1_MAX : AWD23_MAX;
+	if (state == LOW)
+	{
+		LL_ADC_ConfigAnalogWDThresholds(ADC1, awd, aboveThreshold(high, shift), 0);
+	}
+	else
+	{
+		LL_ADC_ConfigAnalogWDThresholds(ADC1, awd, max, belowThreshold(low, shift));
+	}
+}
+
+/**
+ * @brief  Adds an event to the queue.
+ *
+ * @param  queue event queue
+ * @param  source sensor that crossed a threshold
+ * @param  level threshold it crossed
+ * @return None
+ */
+static void pushEvent(EventQueue* queue, SensorEventSource source, Threshold level)
+{
+	uint8_t next = (queue->head + 1) & EVENT_QUEUE_MASK;
+	if (next == queue->tail)
+	{
+		queue->dropped++;
+		return;
+	}
+	SensorEvent* event = &queue->events[queue->head];
+	event->timestamp = getMicros();
+	event->source = source;
+	event->level = level;
+	queue->head = next;
+}
+
+/**
+ * @brief  Starts the watchdogs, before the conversions are started.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void events_init(RobotContext* robot)
+{
+	static const struct
+	{
+		uint32_t watchdog;
+		uint32_t channel;
+		FunctionalState interrupt;
+	} watched[] =
+	{
+		{ADC_ANALOGWATCHDOG_1, ADC_CHANNEL_6, ENABLE},
+		{ADC_ANALOGWATCHDOG_2, ADC_CHANNEL_10, ENABLE},
+		{ADC_ANALOGWATCHDOG_3, ADC_CHANNEL_5, DISABLE},
+		{ADC_ANALOGWATCHDOG_3, ADC_CHANNEL_8, DISABLE},
+		{ADC_ANALOGWATCHDOG_3, ADC_CHANNEL_12, DISABLE},
+	};
+
+	/* The windows cover the whole range until they are set below */
+	ADC_AnalogWDGConfTypeDef config = {0};
+	config.WatchdogMode = ADC_ANALOGWATCHDOG_SINGLE_REG;
+	config.HighThreshold = 0xFFF;
+	config.LowThreshold = 0;
+	for (uint32_t i = 0; i < sizeof(watched) / sizeof(watched[0]); i++)
+	{
+		config.WatchdogNumber = watched[i].watchdog;
+		config.Channel = watched[i].channel;
+		config.ITMode = watched[i].interrupt;
+		if (HAL_ADC_AnalogWDGConfig(&hadc1, &config) != HAL_OK)
+		{
+			Error_Handler();
+		}
+	}
+
+	Sensors* sensors = &robot->sensors;
+	setEncoderWindow(LL_ADC_AWD1, sensors->threshold_left_state, robot->params.encoder_left_low, robot->params.encoder_left_high);
+	setEncoderWindow(LL_ADC_AWD2, sensors->threshold_right_state, robot->params.encoder_right_low, robot->params.encoder_right_high);
+
+	/* Same priority as the DMA of the ADC, so the two never interrupt each other */
+	HAL_NVIC_SetPriority(ADC1_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(ADC1_IRQn);
+}
+
+/**
+ * @brief  Counts the encoder ticks of the queued events and notes a line sensor that saw black.
+ *
+ * Like SchmittTrigger(), every crossing counts one tick in the commanded direction of the
+ * wheel. The windows follow changes of the parameters.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void events_process(RobotContext* robot)
+{
+	Sensors* sensors = &robot->sensors;
+	EventQueue* queue = &sensors->events;
+	while (queue->tail != queue->head)
+	{
+		const SensorEvent* event = &queue->events[queue->tail];
+		switch (event->source)
+		{
+			case EVENT_ENCODER_LEFT:
+				sensors->encoder_left_ticks += (phase2_L_GPIO_Port->ODR & phase2_L_Pin) ? -1 : 1;
+				recordEncoderEdge(&sensors->edge_left_timestamp, &sensors->edge_left_interval, &sensors->edge_left_seen, event->timestamp);
+				break;
+			case EVENT_ENCODER_RIGHT:
+				sensors->encoder_right_ticks += (phase2_R_GPIO_Port->ODR & phase2_R_Pin) ? -1 : 1;
+				recordEncoderEdge(&sensors->edge_right_timestamp, &sensors->edge_right_interval, &sensors->edge_right_seen, event->timestamp);
+				break;
+			case EVENT_LINE:
+				sensors->line_quiet = 0;
+				break;
+		}
+		queue->tail = (queue->tail + 1) & EVENT_QUEUE_MASK;
+	}
+
+	setEncoderWindow(LL_ADC_AWD1, sensors->threshold_left_state, robot->params.encoder_left_low, robot->params.encoder_left_high);
+	setEncoderWindow(LL_ADC_AWD2, sensors->threshold_right_state, robot->params.encoder_right_low, robot->params.encoder_right_high);
+}
+
+/**
+ * @brief  Arms the line sensor watchdog after detectColour() saw all sensors white. Until it
+ * 		   fires, the published frames report the line sensors as quiet.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void events_watchLine(RobotContext* robot)
+{
+	/* Only the ADC interrupt disables the watchdog again, and it is disabled right now */
+	robot->sensors.line_quiet = 1;
+	LL_ADC_ConfigAnalogWDThresholds(ADC1, LL_ADC_AWD3, aboveThreshold(calibration_lineBlack(&robot->calibration, robot->params.black_level), AWD23_SHIFT), 0);
+	__HAL_ADC_CLEAR_FLAG(&hadc1, ADC_FLAG_AWD3);
+	__HAL_ADC_ENABLE_IT(&hadc1, ADC_IT_AWD3);
+}
+
+/**
+ * @brief  The left encoder left the window of AWD1.
+ *
+ * @param  hadc ADC handle structure
+ * @return None
+ */
+void HAL_ADC_LevelOutOfWindowCallback(ADC_HandleTypeDef* hadc)
+{
+	(void) hadc;
+	RobotContext* robot = robot_active;
+	Sensors* sensors = &robot->sensors;
+	sensors->threshold_left_state = sensors->threshold_left_state == LOW ? HIGH : LOW;
+	setEncoderWindow(LL_ADC_AWD1, sensors->threshold_left_state, robot->params.encoder_left_low, robot->params.encoder_left_high);
+	pushEvent(&sensors->events, EVENT_ENCODER_LEFT, sensors->threshold_left_state);
+}
+
+/**
+ * @brief  The right encoder left the window of AWD2.
+ *
+ * @param  hadc ADC handle structure
+ * @return None
+ */
+void HAL_ADCEx_LevelOutOfWindow2Callback(ADC_HandleTypeDef* hadc)
+{
+	(void) hadc;
+	RobotContext* robot = robot_active;
+	Sensors* sensors = &robot->sensors;
+	sensors->threshold_right_state = sensors->threshold_right_state == LOW ? HIGH : LOW;
+	setEncoderWindow(LL_ADC_AWD2, sensors->threshold_right_state, robot->params.encoder_right_low, robot->params.encoder_right_high);
+	pushEvent(&sensors->events, EVENT_ENCODER_RIGHT, sensors->threshold_right_state);
+}
+
+/**
+ * @brief  A line sensor left the window of AWD3. The watchdog would fire on every conversion
+ * 		   while the sensor stays black, so it is disabled until events_watchLine().
+ *
+ * @param  hadc ADC handle structure
+ * @return None
+ */
+void HAL_ADCEx_LevelOutOfWindow3Callback(ADC_HandleTypeDef* hadc)
+{
+	__HAL_ADC_DISABLE_IT(hadc, ADC_IT_AWD3);
+	pushEvent(&robot_active->sensors.events, EVENT_LINE, HIGH);
+}
+
+#endif /* ADC_WATCHDOGS */
@@ -0,0 +1,81 @@
+/**
+ * @brief  Fixed-point low-pass filters for the ADC channels.
+ *
+ * Both filters only use integer additions and shifts, so they are cheap enough to run on
+ * every scan inside the ADC interrupt.
+ *
+ * @author Lukas Probst
+ */
+
+#include "filter.h"
+
+/* Fractional bits of the IIR state, 12 bit samples still fit into 32 bits */
+#define IIR_FRACTION_BITS 16
+
+/**
+ * @brief  Initialises a filter so that it starts settled at a given value.
+ *
+ * @param  filter filter to initialise
+ * @param  type kind of filter
+ * @param  shift smoothing of the filter (see Filter)
+ * @param  initial value the filter starts with
+ * @return None
+ */
+void filter_init(Filter* filter, FilterType type, uint8_t shift, uint16_t initial)
+{
+	if (type == FILTER_MOVING_AVERAGE && shift > FILTER_MAX_SHIFT)
+	{
+		shift = FILTER_MAX_SHIFT;
+	}
+
+	filter->type = type;
+	filter->shift = shift;
+	filter->index = 0;
+
+	if (type == FILTER_IIR)
+	{
+		filter->state = (uint32_t) initial << IIR_FRACTION_BITS;
+	}
+	else
+	{
+		filter->state = (uint32_t) initial << shift;
+	}
+
+	for (int i = 0; i < FILTER_MAX_WINDOW; i++)
+	{
+		filter->history[i] = initial;
+	}
+}
+
+/**
+ * @brief  Feeds a new sample into the filter.
+ *
+ * @param  filter filter to update
+ * @param  sample new ADC value
+ * @return filtered value
+ */
+uint16_t filter_update(Filter* filter, uint16_t sample)
+{
+	switch (filter->type)
+	{
+		case FILTER_IIR:
+		{
+			/* y += (x - y) * 2^-shift */
+			int32_t delta = ((int32_t) sample << IIR_FRACTION_BITS) - (int32_t) filter->state;
+			filter->state += delta >> filter->shift;
+			return (filter->state + (1 << (IIR_FRACTION_BITS - 1))) >> IIR_FRACTION_BITS;
+		}
+		case FILTER_MOVING_AVERAGE:
+		{
+			/* The running sum replaces the oldest sample of the window with the new one */
+			uint8_t window_mask = (1 << filter->shift) - 1;
+			filter->state += sample - filter->history[filter->index];
+			filter->history[filter->index] = sample;
+			filter->index = (filter->index + 1) & window_mask;
+			return filter->state >> filter->shift;
+		}
+		case FILTER_NONE:
+		default:
+			return sample;
+	}
+}
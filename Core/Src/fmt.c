@@ -0,0 +1,166 @@
+/**
+ * @brief  Formatting of integers into buffers of the caller.
+ *
+ * Replaces sprintf() for the text output of the firmware: no heap, no locale, no format
+ * string to parse. Every writer appends to a FmtBuffer and cuts the text at the end of
+ * the buffer.
+ *
+ * @author Lukas Probst
+ */
+
+#include "fmt.h"
+
+/* Decimal digits of the largest uint32_t */
+#define MAX_DIGITS 10
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+/**
+ * @brief  Starts a text in a buffer.
+ *
+ * @param  out text to start
+ * @param  data buffer of the caller
+ * @param  size size of the buffer
+ * @return None
+ */
+void fmt_init(FmtBuffer* out, char* data, uint32_t size)
+{
+	out->data = data;
+	out->size = size;
+	out->len = 0;
+}
+
+/**
+ * @brief  Appends a character.
+ *
+ * @param  out text
+ * @param  c character to append
+ * @return None
+ */
+void fmt_char(FmtBuffer* out, char c)
+{
+	if (out->len < out->size)
+	{
+		out->data[out->len++] = c;
+	}
+}
+
+/**
+ * @brief  Appends a string.
+ *
+ * @param  out text
+ * @param  string string terminated by '\0'
+ * @return None
+ */
+void fmt_string(FmtBuffer* out, const char* string)
+{
+	while (*string != '\0' && out->len < out->size)
+	{
+		out->data[out->len++] = *string++;
+	}
+}
+
+/**
+ * @brief  Appends the digits of a number and a sign, right aligned within a width.
+ */
+static void appendDecimal(FmtBuffer* out, uint32_t value, uint8_t negative, uint8_t width)
+{
+	char digits[MAX_DIGITS];
+	uint32_t count = 0;
+	do
+	{
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	}
+	while (value != 0);
+
+	for (uint32_t i = count + negative; i < width; i++)
+	{
+		fmt_char(out, ' ');
+	}
+	if (negative)
+	{
+		fmt_char(out, '-');
+	}
+	while (count > 0)
+	{
+		fmt_char(out, digits[--count]);
+	}
+}
+
+/**
+ * @brief  Appends an unsigned decimal number.
+ *
+ * @param  out text
+ * @param  value number to append
+ * @param  width minimum number of characters, padded with spaces on the left (0 for none)
+ * @return None
+ */
+void fmt_unsigned(FmtBuffer* out, uint32_t value, uint8_t width)
+{
+	appendDecimal(out, value, 0, width);
+}
+
+/**
+ * @brief  Appends a signed decimal number.
+ *
+ * @param  out text
+ * @param  value number to append
+ * @param  width minimum number of characters including the sign, padded with spaces on the left
+ * @return None
+ */
+void fmt_signed(FmtBuffer* out, int32_t value, uint8_t width)
+{
+	/* The magnitude of INT32_MIN only fits unsigned */
+	uint32_t magnitude = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+	appendDecimal(out, magnitude, value < 0, width);
+}
+
+/**
+ * @brief  Appends a hexadecimal number with a fixed number of digits.
+ *
+ * @param  out text
+ * @param  value number to append
+ * @param  digits number of digits (1 to 8), padded with zeros on the left
+ * @return None
+ */
+void fmt_hex(FmtBuffer* out, uint32_t value, uint8_t digits)
+{
+	if (digits > 8)
+	{
+		digits = 8;
+	}
+	for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+	{
+		fmt_char(out, hex_digits[(value >> shift) & 0xF]);
+	}
+}
+
+/**
+ * @brief  Appends a decimal fraction given as integer, e.g. 4500 with 5 decimals as 0.04500.
+ *
+ * @param  out text
+ * @param  value number in units of 10^-decimals
+ * @param  decimals number of digits after the point (0 to 9)
+ * @return None
+ */
+void fmt_fixed(FmtBuffer* out, int32_t value, uint8_t decimals)
+{
+	uint32_t magnitude = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+	uint32_t scale = 1;
+	for (uint8_t i = 0; i < decimals && i < MAX_DIGITS - 1; i++)
+	{
+		scale *= 10;
+	}
+
+	appendDecimal(out, magnitude / scale, value < 0, 0);
+	if (scale > 1)
+	{
+		fmt_char(out, '.');
+		uint32_t fraction = magnitude % scale;
+		for (scale /= 10; scale > 0; scale /= 10)
+		{
+			fmt_char(out, '0' + fraction / scale % 10);
+		}
+	}
+}
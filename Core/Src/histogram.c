@@ -0,0 +1,82 @@
+/**
+ * @brief  Log2 histograms with count, minimum, mean and maximum, shared by the profiler and
+ * 		   the latency tracing.
+ *
+ * A histogram is written by one interrupt or the main context only, so adding a value needs
+ * no locking. Readers in other contexts take a copy with histogram_copy().
+ *
+ * @author Lukas Probst
+ */
+
+#include "main.h"
+#include "histogram.h"
+
+/**
+ * @brief  Adds a value to a histogram.
+ *
+ * @param  histogram histogram to update
+ * @param  value value to add
+ * @return None
+ */
+void histogram_add(Histogram* histogram, uint32_t value)
+{
+	if (histogram->count == 0 || value < histogram->min)
+	{
+		histogram->min = value;
+	}
+	if (value > histogram->max)
+	{
+		histogram->max = value;
+	}
+	histogram->count++;
+	histogram->sum += value;
+	histogram->buckets[value != 0 ? 31 - __builtin_clz(value) : 0]++;
+}
+
+/**
+ * @brief  Copies a histogram that an interrupt may update meanwhile.
+ *
+ * @param  copy receives the histogram
+ * @param  histogram histogram to copy
+ * @return None
+ */
+void histogram_copy(Histogram* copy, const Histogram* histogram)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	*copy = *histogram;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Appends the statistics of a histogram.
+ *
+ * Format: "n <count>, min <min>, mean <mean>, max <max>, log2 <bucket>:<count> ..."
+ *
+ * @param  out text being built
+ * @param  histogram histogram to format
+ * @return None
+ */
+void histogram_format(FmtBuffer* out, const Histogram* histogram)
+{
+	uint32_t mean = histogram->count != 0 ? (uint32_t) (histogram->sum / histogram->count) : 0;
+	fmt_string(out, "n ");
+	fmt_unsigned(out, histogram->count, 0);
+	fmt_string(out, ", min ");
+	fmt_unsigned(out, histogram->min, 0);
+	fmt_string(out, ", mean ");
+	fmt_unsigned(out, mean, 0);
+	fmt_string(out, ", max ");
+	fmt_unsigned(out, histogram->max, 0);
+	fmt_string(out, ", log2");
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		if (histogram->buckets[i] != 0)
+		{
+			fmt_char(out, ' ');
+			fmt_unsigned(out, i, 0);
+			fmt_char(out, ':');
+			fmt_unsigned(out, histogram->buckets[i], 0);
+		}
+	}
+}
@@ -0,0 +1,121 @@
+/**
+ * @brief  Sensor-to-actuator latency and jitter of the control loop.
+ *
+ * Every published sensor frame carries the time of its latest scan. The behaviour step
+ * remembers the frame its decision is based on, and the next write of the PWM registers by
+ * the velocity control closes the measurement. The velocity control also records how old the
+ * encoder scan is that it reacts to and how far its period deviates from the nominal one. All times come
+ * from the microsecond timebase of TIM2.
+ *
+ * The histograms are exported as text frames within the telemetry, one histogram per output,
+ * and can be read with Host/decode.
+ *
+ * @author Lukas Probst
+ */
+
+#include "main.h"
+#include "utility.h"
+#include "fmt.h"
+#include "histogram.h"
+#include "velocity.h"
+#include "telemetry.h"
+#include "latency.h"
+#include "robot.h"
+
+/* Nominal period of the velocity control in us */
+#define CONTROL_PERIOD_US (1000000 / VELOCITY_CONTROL_RATE_HZ)
+
+static const char* const histogram_names[LATENCY_HISTOGRAMS] =
+{
+	[LATENCY_SENSOR_TO_PWM]  = "sensor_to_pwm",
+	[LATENCY_ENCODER_TO_PWM] = "encoder_to_pwm",
+	[LATENCY_CONTROL_JITTER] = "control_jitter",
+};
+
+/**
+ * @brief  Remembers the frame the current behaviour decision is based on.
+ *
+ * Called at the end of a behaviour step, the targets it set reach the motors with the next
+ * step of the velocity control.
+ *
+ * @param  robot state of the robot
+ * @param  frame snapshot the decision was based on
+ * @return None
+ */
+void latency_decision(RobotContext* robot, const SensorFrame* frame)
+{
+	robot->latency.decision_timestamp = frame->timestamp;
+	__DMB();
+	robot->latency.decision_pending = 1;
+}
+
+/**
+ * @brief  Records the period of the velocity control, called at the start of every step.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void latency_controlPeriod(RobotContext* robot)
+{
+	Latency* latency = &robot->latency;
+	uint32_t now = getMicros();
+	if (latency->last_control != 0)
+	{
+		int32_t deviation = (int32_t) (now - latency->last_control) - CONTROL_PERIOD_US;
+		histogram_add(&latency->histograms[LATENCY_CONTROL_JITTER], deviation < 0 ? -deviation : deviation);
+	}
+	latency->last_control = now;
+}
+
+/**
+ * @brief  Closes the measurements when the velocity control has written the PWM registers.
+ *
+ * @param  robot state of the robot
+ * @param  frame_timestamp time of the latest scan of the frame the control step was based on
+ * @return None
+ */
+void latency_pwmWritten(RobotContext* robot, uint32_t frame_timestamp)
+{
+	Latency* latency = &robot->latency;
+	uint32_t now = getMicros();
+
+	histogram_add(&latency->histograms[LATENCY_ENCODER_TO_PWM], now - frame_timestamp);
+
+	if (latency->decision_pending)
+	{
+		histogram_add(&latency->histograms[LATENCY_SENSOR_TO_PWM], now - latency->decision_timestamp);
+		latency->decision_pending = 0;
+	}
+}
+
+/**
+ * @brief  Sends one histogram per call during the first calls of every report interval.
+ *
+ * Line format: "# latency <name>: n <count>, min <us>, mean <us>, max <us>, log2 <bucket>:<count> ..."
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void latency_report(RobotContext* robot)
+{
+	Latency* latency = &robot->latency;
+	uint32_t index = latency->report_counter;
+	latency->report_counter = (latency->report_counter + 1) % LATENCY_REPORT_INTERVAL;
+	if (index >= LATENCY_HISTOGRAMS)
+	{
+		return;
+	}
+
+	Histogram histogram;
+	histogram_copy(&histogram, &latency->histograms[index]);
+
+	char string_buf[200];
+	FmtBuffer out;
+	fmt_init(&out, string_buf, sizeof(string_buf) - 1);
+	fmt_string(&out, "# latency ");
+	fmt_string(&out, histogram_names[index]);
+	fmt_string(&out, ": ");
+	histogram_format(&out, &histogram);
+	string_buf[out.len++] = '\n';
+	telemetry_sendText(&robot->telemetry, string_buf, out.len);
+}
@@ -14,47 +14,76 @@
 #include "tim.h"
 #include "usart.h"
 #include "gpio.h"
-#include "sensors.h"
-#include "tasks.h"
-#include "utility.h"
-
-#include <stdio.h>
-
-volatile uint32_t adc[6];
-uint32_t buffer[6];
-
-uint32_t encoder_left_cnt;
-uint32_t encoder_right_cnt;
-
-double speed_left;
-double speed_right;
-
-Linesensor left_linesensor_state;
-Linesensor middle_linesensor_state;
-Linesensor right_linesensor_state;
-
-RaceState current_state;
+#include "robot.h"
+#include "command.h"
+#include "recorder.h"
+#include "scheduler.h"
+#include "profiler.h"
+
+/* Rates of the jobs in the main context (SysTick runs at 1 kHz) */
+#define BEHAVIOUR_RATE_HZ 200
+#define TELEMETRY_RATE_HZ 200
+#define COMMAND_RATE_HZ   50
+#define PROFILER_RATE_HZ  20
 
 /* Private function prototypes */
 void SystemClock_Config(void);
 
+/* The only instance of the robot on the microcontroller */
+static RobotContext robot;
+
 /**
- * @brief  Sets the initial properties.
+ * @brief  Runs one behaviour step of the robot.
  *
  * @return None
  */
-void setup()
+static void job_behaviour()
 {
-	resetEncoderCnt();
+	robot_step(&robot);
+}
 
-	/* The generation of PWM signals must be activated */
-	HAL_TIMEx_PWMN_Start(&htim1, TIM_CHANNEL_2);
-	HAL_TIMEx_PWMN_Start(&htim1, TIM_CHANNEL_3);
+/**
+ * @brief  Sends the telemetry of the robot.
+ *
+ * @return None
+ */
+static void job_telemetry()
+{
+	robot_outputTelemetry(&robot);
+}
 
-	setNormalSpeed();
+/**
+ * @brief  Executes the commands received over USART2.
+ *
+ * @return None
+ */
+static void job_command()
+{
+	command_poll(&robot);
+}
 
-	current_state = FOLLOW_TRAJECTORY;
+#ifdef PROFILING
+/**
+ * @brief  Sends a pending report of the profiler.
+ *
+ * @return None
+ */
+static void job_profiler()
+{
+	profiler_poll(&robot.telemetry);
 }
+#endif
+
+/* Jobs of the main context in the order of their priority */
+Job jobs[] =
+{
+	{.name = "behaviour", .period = 1000 / BEHAVIOUR_RATE_HZ, .run = job_behaviour},
+	{.name = "telemetry", .period = 1000 / TELEMETRY_RATE_HZ, .run = job_telemetry},
+	{.name = "command", .period = 1000 / COMMAND_RATE_HZ, .run = job_command},
+#ifdef PROFILING
+	{.name = "profiler", .period = 1000 / PROFILER_RATE_HZ, .run = job_profiler},
+#endif
+};
 
 /**
   * @brief  The application entry point.
@@ -77,40 +106,16 @@ int main(void)
   MX_USART2_UART_Init();
   MX_ADC1_Init();
   MX_TIM1_Init();
+  MX_TIM6_Init();
+  MX_TIM2_Init();
+  MX_TIM7_Init();
 
-  setup();
+#ifdef PROFILING
+  profiler_init();
+#endif
+  robot_init(&robot);
 
-  while (1)
-  {
-	  HAL_ADC_Start_DMA(&hadc1, buffer, 6);
-	  /* Output of ADC values here */
-
-	  SchmittTrigger();
-	  detectColour();
-
-	  /* Check if power switch is activated before starting the robot-routine (prevents driving when it is still connected via USB) */
-	  if (BATTERY)
-  	  {
-		  switch (current_state)
-		  {
-		  	  case FOLLOW_TRAJECTORY:
-				  task_followTrajectory();
-				  break;
-			  case FOLLOW_LINE:
-				  task_followLine();
-				  break;
-			  case SEARCH_LINE:
-				  task_searchLine();
-				  break;
-			  case AVOID_OBSTACLE:
-				  task_avoidObstacle();
-				  break;
-			  case FINISH_LINE:
-				  task_finishLine();
-				  break;
-		  }
-  	  }
-  }
+  scheduler_run(jobs, sizeof(jobs) / sizeof(jobs[0]));
 }
 
 /**
@@ -170,12 +175,16 @@ void SystemClock_Config(void)
 /**
   * @brief  This function is executed in case of error occurrence.
   *
+  * The flight recorder keeps the seconds before the error and is sent once.
+  *
   * @return None
   */
 void Error_Handler(void)
 {
   /* User can add his own implementation to report the HAL error return state */
   __disable_irq();
+  recorder_freeze(&robot.recorder, RECORDER_ERROR);
+  recorder_dumpBlocking(&robot);
   while (1)
   {
   }
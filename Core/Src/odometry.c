@@ -0,0 +1,90 @@
+/**
+ * @brief  Odometry of the differential drive.
+ *
+ * The signed encoder ticks of both wheels are integrated into the pose of the robot at the
+ * rate of the velocity control.
+ *
+ * @author Lukas Probst
+ */
+
+#include <math.h>
+
+#include "main.h"
+#include "sensors.h"
+#include "odometry.h"
+#include "robot.h"
+
+/**
+ * @brief  Sets the pose back to the origin.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void resetOdometry(RobotContext* robot)
+{
+	Odometry* odometry = &robot->odometry;
+	odometry->lock++;
+	__DMB();
+	odometry->last_ticks_left = robot->sensors.encoder_left_ticks;
+	odometry->last_ticks_right = robot->sensors.encoder_right_ticks;
+	odometry->pose.x = 0;
+	odometry->pose.y = 0;
+	odometry->pose.theta = 0;
+	odometry->pose.distance = 0;
+	__DMB();
+	odometry->lock++;
+}
+
+/**
+ * @brief  Integrates the ticks since the last call into the pose.
+ *
+ * The movement within one period is approximated by an arc, whose chord is taken in the
+ * direction of the mean heading.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void updateOdometry(RobotContext* robot)
+{
+	Odometry* odometry = &robot->odometry;
+	int32_t ticks_left = robot->sensors.encoder_left_ticks;
+	int32_t ticks_right = robot->sensors.encoder_right_ticks;
+	float left = (ticks_left - odometry->last_ticks_left) * ENCODER_TICK_MM;
+	float right = (ticks_right - odometry->last_ticks_right) * ENCODER_TICK_MM;
+	odometry->last_ticks_left = ticks_left;
+	odometry->last_ticks_right = ticks_right;
+
+	float distance = (left + right) / 2;
+	float rotation = (right - left) / WHEEL_BASE_MM;
+	float heading = odometry->pose.theta + rotation / 2;
+
+	odometry->lock++;
+	__DMB();
+	odometry->pose.x += distance * cosf(heading);
+	odometry->pose.y += distance * sinf(heading);
+	odometry->pose.theta += rotation;
+	odometry->pose.distance += distance;
+	__DMB();
+	odometry->lock++;
+}
+
+/**
+ * @brief  Takes a consistent copy of the current pose.
+ *
+ * @param  robot state of the robot
+ * @param  pose receives the pose
+ * @return None
+ */
+void getPose(RobotContext* robot, Pose* pose)
+{
+	Odometry* odometry = &robot->odometry;
+	uint32_t lock;
+	do
+	{
+		lock = odometry->lock;
+		__DMB();
+		*pose = odometry->pose;
+		__DMB();
+	}
+	while ((lock & 1) != 0 || lock != odometry->lock);
+}
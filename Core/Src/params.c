@@ -0,0 +1,184 @@
+/**
+ * @brief  Tunable parameters with their defaults.
+ *
+ * The values are tuned for the parkour in parkour.jpg. Every robot instance starts with a copy
+ * of them, so the host tools can vary them without recompiling the firmware. The registry
+ * names them for the command interface, which changes them while the robot is running.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "params.h"
+
+/* Factor between a value and its representation as integer, per ParamType */
+#define SCALE_PARAM_Q16   10000
+#define SCALE_PARAM_U16   1
+#define SCALE_PARAM_FLOAT 100
+
+/* Registry entry with its valid range in the units of the parameter */
+#define PARAM(field, type, min, max) \
+	{#field, type, offsetof(Params, field), (int32_t) ((min) * SCALE_##type), (int32_t) ((max) * SCALE_##type)}
+
+const Params default_params =
+{
+	.line_gain = Q16(144),
+	.straight_gain = Q16(0.15),
+
+	.normal_speed = Q16(150),
+
+	.encoder_left_high = 2500,
+	.encoder_left_low = 1000,
+	.encoder_right_high = 2750,
+	.encoder_right_low = 1000,
+	.encoder_calibration = 1,
+
+	.black_level = Q16(0.34375),
+
+	.line_calibration = 0,
+	.line_sweep_degree = 45,
+
+	.first_straight_length = 470,
+	.right_curve_degree = 150,
+	.second_straight_length = 355,
+	.left_curve_degree = 90,
+	.third_straight_length = 320,
+
+	.half_perimeter_degree = 100,
+	.next_perimeter_length = 80,
+
+	.obstacle_reverse_length = 25,
+	.obstacle_turn_degree = 55,
+
+	.last_part_indication = 395,
+
+	.finish_line_spurt = 100,
+};
+
+const ParamInfo param_registry[] =
+{
+	PARAM(line_gain, PARAM_Q16, 0, 500),
+	PARAM(straight_gain, PARAM_Q16, 0, 1),
+	PARAM(normal_speed, PARAM_Q16, 0, 300),
+	PARAM(encoder_left_high, PARAM_U16, 0, 4095),
+	PARAM(encoder_left_low, PARAM_U16, 0, 4095),
+	PARAM(encoder_right_high, PARAM_U16, 0, 4095),
+	PARAM(encoder_right_low, PARAM_U16, 0, 4095),
+	PARAM(encoder_calibration, PARAM_U16, 0, 1),
+	PARAM(black_level, PARAM_Q16, 0, 1),
+	PARAM(line_sweep_degree, PARAM_FLOAT, 0, 180),
+	PARAM(first_straight_length, PARAM_FLOAT, 0, 2000),
+	PARAM(right_curve_degree, PARAM_FLOAT, 0, 360),
+	PARAM(second_straight_length, PARAM_FLOAT, 0, 2000),
+	PARAM(left_curve_degree, PARAM_FLOAT, 0, 360),
+	PARAM(third_straight_length, PARAM_FLOAT, 0, 2000),
+	PARAM(half_perimeter_degree, PARAM_FLOAT, 0, 360),
+	PARAM(next_perimeter_length, PARAM_FLOAT, 0, 2000),
+	PARAM(obstacle_reverse_length, PARAM_FLOAT, 0, 2000),
+	PARAM(obstacle_turn_degree, PARAM_FLOAT, 0, 360),
+	PARAM(last_part_indication, PARAM_FLOAT, 0, 2000),
+	PARAM(finish_line_spurt, PARAM_FLOAT, 0, 2000),
+};
+
+const uint32_t param_count = sizeof(param_registry) / sizeof(param_registry[0]);
+
+/**
+ * @brief  Looks up a parameter by its name.
+ *
+ * @param  name characters of the name, need not be terminated
+ * @param  len number of characters
+ * @return entry of the registry, NULL if there is no such parameter
+ */
+const ParamInfo* params_find(const char* name, uint32_t len)
+{
+	for (uint32_t i = 0; i < param_count; i++)
+	{
+		if (strncmp(param_registry[i].name, name, len) == 0 && param_registry[i].name[len] == '\0')
+		{
+			return &param_registry[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief  Number of decimal places of the integer representation of a type.
+ *
+ * @param  type type of the parameter
+ * @return decimal places
+ */
+uint8_t params_decimals(ParamType type)
+{
+	switch (type)
+	{
+		case PARAM_Q16:
+			return 4;
+		case PARAM_FLOAT:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * @brief  Reads a parameter.
+ *
+ * @param  params parameters of a robot
+ * @param  info entry of the registry
+ * @return value in units of 10^-params_decimals()
+ */
+int32_t params_get(const Params* params, const ParamInfo* info)
+{
+	const uint8_t* field = (const uint8_t*) params + info->offset;
+	switch (info->type)
+	{
+		case PARAM_Q16:
+		{
+			int64_t value = *(const q16_t*) field;
+			return (int32_t) ((value * SCALE_PARAM_Q16 + (value < 0 ? -Q16_ONE / 2 : Q16_ONE / 2)) / Q16_ONE);
+		}
+		case PARAM_FLOAT:
+		{
+			float value = *(const float*) field * SCALE_PARAM_FLOAT;
+			return (int32_t) (value < 0 ? value - 0.5f : value + 0.5f);
+		}
+		default:
+			return *(const uint16_t*) field;
+	}
+}
+
+/**
+ * @brief  Changes a parameter.
+ *
+ * Every parameter is written with a single store, so the interrupts that read it see either
+ * the old or the new value.
+ *
+ * @param  params parameters of a robot
+ * @param  info entry of the registry
+ * @param  value new value in units of 10^-params_decimals()
+ * @return 1 if the value was set, 0 if it is out of range
+ */
+uint8_t params_set(Params* params, const ParamInfo* info, int32_t value)
+{
+	if (value < info->min || value > info->max)
+	{
+		return 0;
+	}
+
+	uint8_t* field = (uint8_t*) params + info->offset;
+	switch (info->type)
+	{
+		case PARAM_Q16:
+			*(volatile q16_t*) field = (q16_t) (((int64_t) value * Q16_ONE + (value < 0 ? -SCALE_PARAM_Q16 / 2 : SCALE_PARAM_Q16 / 2)) / SCALE_PARAM_Q16);
+			break;
+		case PARAM_FLOAT:
+			*(volatile float*) field = (float) value / SCALE_PARAM_FLOAT;
+			break;
+		default:
+			*(volatile uint16_t*) field = (uint16_t) value;
+			break;
+	}
+	return 1;
+}
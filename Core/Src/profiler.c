@@ -0,0 +1,169 @@
+/**
+ * @brief  Execution time profiler based on the DWT cycle counter.
+ *
+ * Every zone keeps the number of calls, the minimum, maximum and mean duration and a log2
+ * histogram in cycles of the core clock. A zone is only ever written by one context (the ADC
+ * interrupt or the main context), so recording needs no locking. The commands "profile" and
+ * "profile reset" (see command.c) request a report and reset the statistics. The report is
+ * written one zone per call of profiler_poll(), so it never fills the telemetry ring at once.
+ *
+ * @author Lukas Probst
+ */
+
+#ifdef PROFILING
+
+#include "fmt.h"
+#include "histogram.h"
+#include "profiler.h"
+
+static const char* const zone_names[PROFILE_ZONES] =
+{
+	[PROFILE_ADC_BLOCK]         = "adc_block",
+	[PROFILE_SCHMITT_TRIGGER]   = "schmitt_trigger",
+	[PROFILE_DETECT_COLOUR]     = "detect_colour",
+	[PROFILE_FOLLOW_TRAJECTORY] = "follow_trajectory",
+	[PROFILE_FOLLOW_LINE]       = "follow_line",
+	[PROFILE_SEARCH_LINE]       = "search_line",
+	[PROFILE_AVOID_OBSTACLE]    = "avoid_obstacle",
+	[PROFILE_FINISH_LINE]       = "finish_line",
+	[PROFILE_CALIBRATE_LINE]    = "calibrate_line",
+};
+
+/* Durations of every zone in CPU cycles */
+static Histogram stats[PROFILE_ZONES];
+
+/* Cycles an empty zone measures, subtracted from every measurement */
+static uint32_t overhead = 0;
+
+/* Next line of the report, -1 if no report is pending */
+static int32_t report_line = -1;
+
+/**
+ * @brief  Clears the statistics of all zones.
+ *
+ * @return None
+ */
+void profiler_reset()
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (int i = 0; i < PROFILE_ZONES; i++)
+	{
+		stats[i] = (Histogram) {0};
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief  Starts the cycle counter and measures the overhead of a zone.
+ *
+ * @return None
+ */
+void profiler_init()
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	/* The shortest empty zone is the cost of the measurement itself */
+	overhead = 0;
+	profiler_reset();
+	for (int i = 0; i < 8; i++)
+	{
+		PROFILE_ZONE(PROFILE_ADC_BLOCK);
+	}
+	overhead = stats[PROFILE_ADC_BLOCK].min;
+	profiler_reset();
+}
+
+/**
+ * @brief  Closes a zone and adds its duration to the statistics.
+ *
+ * @param  scope zone that is left
+ * @return None
+ */
+void profiler_leave(ProfileScope* scope)
+{
+	uint32_t cycles = DWT->CYCCNT - scope->start;
+	cycles = cycles > overhead ? cycles - overhead : 0;
+
+	histogram_add(&stats[scope->zone], cycles);
+}
+
+/**
+ * @brief  Formats one line of the report.
+ *
+ * @param  line number of the line, 0 is the header
+ * @param  string_buf receives the line
+ * @param  size size of string_buf
+ * @return length of the line
+ */
+static uint32_t formatReport(int32_t line, char* string_buf, uint32_t size)
+{
+	FmtBuffer out;
+
+	/* One character stays free for the newline */
+	fmt_init(&out, string_buf, size - 1);
+	if (line == 0)
+	{
+		fmt_string(&out, "# profile clock: ");
+		fmt_unsigned(&out, SystemCoreClock, 0);
+		fmt_string(&out, " Hz, overhead ");
+		fmt_unsigned(&out, overhead, 0);
+		fmt_string(&out, " cycles");
+		string_buf[out.len++] = '\n';
+		return out.len;
+	}
+
+	Histogram zone;
+	histogram_copy(&zone, &stats[line - 1]);
+
+	fmt_string(&out, "# profile ");
+	fmt_string(&out, zone_names[line - 1]);
+	fmt_string(&out, ": ");
+	histogram_format(&out, &zone);
+	string_buf[out.len++] = '\n';
+	return out.len;
+}
+
+/**
+ * @brief  Requests a report, ignored while a report is being sent.
+ *
+ * @return None
+ */
+void profiler_requestReport()
+{
+	if (report_line < 0)
+	{
+		report_line = 0;
+	}
+}
+
+/**
+ * @brief  Sends the next line of a pending report.
+ *
+ * @param  telemetry transmit ring of the report
+ * @return None
+ */
+void profiler_poll(Telemetry* telemetry)
+{
+	if (report_line < 0)
+	{
+		return;
+	}
+
+	char string_buf[400];
+	uint32_t len = formatReport(report_line, string_buf, sizeof(string_buf));
+
+	/* A dropped line is sent again on the next call */
+	if (telemetry_sendText(telemetry, string_buf, len))
+	{
+		report_line++;
+		if (report_line > PROFILE_ZONES)
+		{
+			report_line = -1;
+		}
+	}
+}
+
+#endif /* PROFILING */
@@ -0,0 +1,514 @@
+/**
+ * @brief  Binary telemetry protocol.
+ *
+ * Every frame is a payload followed by its CRC-16 (CCITT, little endian), COBS encoded and
+ * terminated by a zero byte, so a receiver can always resynchronise at the next zero.
+ *
+ * Payload of a frame:
+ *   version << 4 | type, sequence number,
+ *   sample: fields (| PROTOCOL_KEY), timestamp, then the selected fields in the order of
+ *           their bits: ADC, encoders, state, PWM
+ *   text:   the characters of a line
+ *   record: trigger, signed position relative to the trigger, sub-state, then a sample as
+ *           key frame with all fields
+ *
+ * Key frames carry absolute values, the ADC samples packed to 12 bits. All other sample
+ * frames carry the differences to the previous sample. Timestamps, differences, encoder
+ * counts and PWM values are variable-length integers (7 bits per byte, signed values
+ * zigzag encoded). A key frame is sent at least every PROTOCOL_KEY_INTERVAL samples and
+ * whenever the sender lost a frame. Record frames carry the flight recorder (recorder.c) and
+ * do not change the delta state of the samples.
+ *
+ * The module does not depend on the hardware, the host decoder is built from the same file.
+ *
+ * @author Lukas Probst
+ */
+
+#include <string.h>
+
+#include "protocol.h"
+
+/* Longest payload of a sample frame */
+#define MAX_SAMPLE_PAYLOAD 64
+
+/**
+ * @brief  CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF).
+ *
+ * @param  data bytes to check
+ * @param  len number of bytes
+ * @return CRC of the bytes
+ */
+uint16_t protocol_crc16(const uint8_t* data, uint32_t len)
+{
+	uint16_t crc = 0xFFFF;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		crc ^= (uint16_t) data[i] << 8;
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+/**
+ * @brief  COBS encodes a payload and appends the zero delimiter.
+ *
+ * @param  data payload
+ * @param  len length of the payload
+ * @param  out receives the frame, at least len + len / 254 + 2 bytes
+ * @return length of the frame including the delimiter
+ */
+uint32_t protocol_cobsEncode(const uint8_t* data, uint32_t len, uint8_t* out)
+{
+	uint32_t code_index = 0;
+	uint32_t o = 1;
+	uint8_t code = 1;
+
+	for (uint32_t i = 0; i < len; i++)
+	{
+		if (data[i] == 0)
+		{
+			out[code_index] = code;
+			code_index = o++;
+			code = 1;
+			continue;
+		}
+
+		out[o++] = data[i];
+		code++;
+		if (code == 0xFF)
+		{
+			out[code_index] = code;
+			code_index = o++;
+			code = 1;
+		}
+	}
+
+	out[code_index] = code;
+	out[o++] = 0;
+	return o;
+}
+
+/**
+ * @brief  Decodes a COBS frame.
+ *
+ * @param  data frame without the zero delimiter
+ * @param  len length of the frame
+ * @param  out receives the payload, at least len bytes
+ * @return length of the payload, 0 if the frame is malformed
+ */
+uint32_t protocol_cobsDecode(const uint8_t* data, uint32_t len, uint8_t* out)
+{
+	uint32_t i = 0;
+	uint32_t o = 0;
+
+	while (i < len)
+	{
+		uint8_t code = data[i++];
+		if (code == 0)
+		{
+			return 0;
+		}
+		for (uint8_t j = 1; j < code; j++)
+		{
+			if (i >= len || data[i] == 0)
+			{
+				return 0;
+			}
+			out[o++] = data[i++];
+		}
+		if (code != 0xFF && i < len)
+		{
+			out[o++] = 0;
+		}
+	}
+	return o;
+}
+
+static uint8_t* putVarint(uint8_t* p, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		*p++ = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (uint8_t) value;
+	return p;
+}
+
+static uint8_t* putSigned(uint8_t* p, int32_t value)
+{
+	return putVarint(p, ((uint32_t) value << 1) ^ (uint32_t) (value >> 31));
+}
+
+static const uint8_t* getVarint(const uint8_t* p, const uint8_t* end, uint32_t* value)
+{
+	uint32_t result = 0;
+	for (int shift = 0; shift < 35 && p < end; shift += 7)
+	{
+		uint8_t byte = *p++;
+		result |= (uint32_t) (byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			*value = result;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static const uint8_t* getSigned(const uint8_t* p, const uint8_t* end, int32_t* value)
+{
+	uint32_t zigzag;
+	p = getVarint(p, end, &zigzag);
+	if (p != NULL)
+	{
+		*value = (int32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+	}
+	return p;
+}
+
+/**
+ * @brief  Adds the CRC and the framing to a payload.
+ */
+static uint32_t finishFrame(uint8_t* payload, uint32_t len, uint8_t* out)
+{
+	uint16_t crc = protocol_crc16(payload, len);
+	payload[len++] = (uint8_t) crc;
+	payload[len++] = (uint8_t) (crc >> 8);
+	return protocol_cobsEncode(payload, len, out);
+}
+
+/**
+ * @brief  Writes the field byte and the values of a sample, as differences unless key is set.
+ */
+static uint8_t* putSample(uint8_t* p, uint8_t fields, uint8_t key, const ProtocolSample* sample, const ProtocolSample* previous)
+{
+	*p++ = fields | (key ? PROTOCOL_KEY : 0);
+	p = putVarint(p, key ? sample->timestamp : sample->timestamp - previous->timestamp);
+
+	if (fields & PROTOCOL_FIELD_ADC)
+	{
+		for (int i = 0; i < PROTOCOL_ADC_CHANNELS; i += 2)
+		{
+			if (key)
+			{
+				/* Two samples of 12 bits in three bytes */
+				uint16_t a = sample->adc[i] & 0x0FFF;
+				uint16_t b = sample->adc[i + 1] & 0x0FFF;
+				*p++ = (uint8_t) a;
+				*p++ = (uint8_t) ((a >> 8) | (b << 4));
+				*p++ = (uint8_t) (b >> 4);
+			}
+			else
+			{
+				p = putSigned(p, sample->adc[i] - previous->adc[i]);
+				p = putSigned(p, sample->adc[i + 1] - previous->adc[i + 1]);
+			}
+		}
+	}
+	if (fields & PROTOCOL_FIELD_ENCODERS)
+	{
+		p = putSigned(p, key ? sample->encoder_left : sample->encoder_left - previous->encoder_left);
+		p = putSigned(p, key ? sample->encoder_right : sample->encoder_right - previous->encoder_right);
+	}
+	if (fields & PROTOCOL_FIELD_STATE)
+	{
+		*p++ = sample->state;
+	}
+	if (fields & PROTOCOL_FIELD_PWM)
+	{
+		p = putSigned(p, key ? sample->pwm_left : sample->pwm_left - previous->pwm_left);
+		p = putSigned(p, key ? sample->pwm_right : sample->pwm_right - previous->pwm_right);
+	}
+	return p;
+}
+
+/**
+ * @brief  Reads the values of a sample, differences are added to the values in sample.
+ *
+ * @return position after the values, NULL if the payload ends too early
+ */
+static const uint8_t* getSample(const uint8_t* p, const uint8_t* end, uint8_t key, uint8_t fields, ProtocolSample* sample)
+{
+	uint32_t timestamp;
+	p = getVarint(p, end, &timestamp);
+	if (p != NULL)
+	{
+		sample->timestamp = key ? timestamp : sample->timestamp + timestamp;
+	}
+
+	if (p != NULL && (fields & PROTOCOL_FIELD_ADC))
+	{
+		for (int i = 0; i < PROTOCOL_ADC_CHANNELS && p != NULL; i += 2)
+		{
+			if (key)
+			{
+				if (end - p < 3)
+				{
+					p = NULL;
+					break;
+				}
+				sample->adc[i] = p[0] | ((p[1] & 0x0F) << 8);
+				sample->adc[i + 1] = (p[1] >> 4) | (p[2] << 4);
+				p += 3;
+			}
+			else
+			{
+				int32_t a, b;
+				p = getSigned(p, end, &a);
+				p = p != NULL ? getSigned(p, end, &b) : NULL;
+				if (p != NULL)
+				{
+					sample->adc[i] += a;
+					sample->adc[i + 1] += b;
+				}
+			}
+		}
+	}
+	if (p != NULL && (fields & PROTOCOL_FIELD_ENCODERS))
+	{
+		int32_t left, right;
+		p = getSigned(p, end, &left);
+		p = p != NULL ? getSigned(p, end, &right) : NULL;
+		if (p != NULL)
+		{
+			sample->encoder_left += left;
+			sample->encoder_right += right;
+		}
+	}
+	if (p != NULL && (fields & PROTOCOL_FIELD_STATE))
+	{
+		p = p < end ? p : NULL;
+		if (p != NULL)
+		{
+			sample->state = *p++;
+		}
+	}
+	if (p != NULL && (fields & PROTOCOL_FIELD_PWM))
+	{
+		int32_t left, right;
+		p = getSigned(p, end, &left);
+		p = p != NULL ? getSigned(p, end, &right) : NULL;
+		if (p != NULL)
+		{
+			sample->pwm_left += left;
+			sample->pwm_right += right;
+		}
+	}
+	return p;
+}
+
+/**
+ * @brief  Prepares a stream, the first sample frame is a key frame.
+ *
+ * @param  stream state of the link
+ * @param  fields fields the encoder sends (PROTOCOL_FIELD_*)
+ * @return None
+ */
+void protocol_init(ProtocolStream* stream, uint8_t fields)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->fields = fields & PROTOCOL_FIELDS_ALL;
+}
+
+/**
+ * @brief  Makes the next sample frame a key frame, e.g. after a frame could not be sent.
+ *
+ * @param  stream state of the link
+ * @return None
+ */
+void protocol_resync(ProtocolStream* stream)
+{
+	stream->frames_to_key = 0;
+}
+
+/**
+ * @brief  Encodes a sample frame with the fields of the stream.
+ *
+ * @param  stream state of the link
+ * @param  sample values to send
+ * @param  out receives the frame, PROTOCOL_MAX_FRAME bytes
+ * @return length of the frame
+ */
+uint32_t protocol_encodeSample(ProtocolStream* stream, const ProtocolSample* sample, uint8_t* out)
+{
+	uint8_t payload[MAX_SAMPLE_PAYLOAD];
+	uint8_t* p = payload;
+	uint8_t key = stream->frames_to_key == 0;
+
+	*p++ = (PROTOCOL_VERSION << 4) | PROTOCOL_SAMPLE;
+	*p++ = stream->sequence++;
+	p = putSample(p, stream->fields, key, sample, &stream->previous);
+
+	stream->previous = *sample;
+	stream->frames_to_key = key ? PROTOCOL_KEY_INTERVAL - 1 : stream->frames_to_key - 1;
+	return finishFrame(payload, p - payload, out);
+}
+
+/**
+ * @brief  Encodes a line of text, e.g. statistics, as a text frame.
+ *
+ * @param  stream state of the link
+ * @param  text characters of the line, longer texts are cut
+ * @param  len number of characters
+ * @param  out receives the frame, PROTOCOL_MAX_FRAME bytes
+ * @return length of the frame
+ */
+uint32_t protocol_encodeText(ProtocolStream* stream, const char* text, uint32_t len, uint8_t* out)
+{
+	uint8_t payload[PROTOCOL_MAX_TEXT + 4];
+	if (len > PROTOCOL_MAX_TEXT)
+	{
+		len = PROTOCOL_MAX_TEXT;
+	}
+
+	payload[0] = (PROTOCOL_VERSION << 4) | PROTOCOL_TEXT;
+	payload[1] = stream->sequence++;
+	memcpy(&payload[2], text, len);
+	return finishFrame(payload, len + 2, out);
+}
+
+/**
+ * @brief  Encodes a record of the flight recorder as a record frame.
+ *
+ * @param  stream state of the link
+ * @param  record values and position of the record
+ * @param  out receives the frame, PROTOCOL_MAX_FRAME bytes
+ * @return length of the frame
+ */
+uint32_t protocol_encodeRecord(ProtocolStream* stream, const ProtocolRecord* record, uint8_t* out)
+{
+	uint8_t payload[MAX_SAMPLE_PAYLOAD + 8];
+	uint8_t* p = payload;
+
+	*p++ = (PROTOCOL_VERSION << 4) | PROTOCOL_RECORD;
+	*p++ = stream->sequence++;
+	*p++ = record->trigger;
+	*p++ = record->sub_state;
+	p = putSigned(p, record->position);
+	p = putSample(p, PROTOCOL_FIELDS_ALL, 1, &record->sample, NULL);
+	return finishFrame(payload, p - payload, out);
+}
+
+/**
+ * @brief  Decodes a frame.
+ *
+ * A sample frame that follows a lost or broken frame can only be decoded if it is a key
+ * frame, as the differences refer to values that were not received.
+ *
+ * @param  stream state of the link
+ * @param  frame frame without the zero delimiter
+ * @param  len length of the frame
+ * @param  message receives the content
+ * @return ProtocolType of the frame or PROTOCOL_ERROR_*
+ */
+int32_t protocol_decode(ProtocolStream* stream, const uint8_t* frame, uint32_t len, ProtocolMessage* message)
+{
+	uint8_t payload[PROTOCOL_MAX_FRAME];
+	if (len > sizeof(payload))
+	{
+		stream->synchronised = 0;
+		return PROTOCOL_ERROR_FRAMING;
+	}
+
+	uint32_t n = protocol_cobsDecode(frame, len, payload);
+	if (n < 4)
+	{
+		stream->synchronised = 0;
+		return PROTOCOL_ERROR_FRAMING;
+	}
+	if (protocol_crc16(payload, n - 2) != (payload[n - 2] | (payload[n - 1] << 8)))
+	{
+		stream->synchronised = 0;
+		return PROTOCOL_ERROR_CRC;
+	}
+	if ((payload[0] >> 4) != PROTOCOL_VERSION)
+	{
+		stream->synchronised = 0;
+		return PROTOCOL_ERROR_VERSION;
+	}
+
+	message->type = payload[0] & 0x0F;
+	message->sequence = payload[1];
+	message->lost = stream->receiving ? (uint8_t) (payload[1] - stream->sequence) : 0;
+	stream->sequence = payload[1] + 1;
+	stream->receiving = 1;
+	if (message->lost != 0)
+	{
+		stream->synchronised = 0;
+	}
+
+	const uint8_t* p = &payload[2];
+	const uint8_t* end = &payload[n - 2];
+
+	if (message->type == PROTOCOL_TEXT)
+	{
+		/* protocol_encodeText() cuts longer texts, so such a frame is malformed */
+		if (end - p > PROTOCOL_MAX_TEXT)
+		{
+			return PROTOCOL_ERROR_FRAMING;
+		}
+		message->text_len = end - p;
+		memcpy(message->text, p, message->text_len);
+		message->text[message->text_len] = '\0';
+		return PROTOCOL_TEXT;
+	}
+	if (message->type == PROTOCOL_RECORD)
+	{
+		/* Records are key frames with all fields and leave the delta state of the samples alone */
+		memset(&message->record, 0, sizeof(message->record));
+		p = end - p >= 2 ? p : NULL;
+		if (p != NULL)
+		{
+			message->record.trigger = *p++;
+			message->record.sub_state = *p++;
+			p = getSigned(p, end, &message->record.position);
+		}
+		if (p == NULL || p == end || *p++ != (PROTOCOL_FIELDS_ALL | PROTOCOL_KEY)
+				|| getSample(p, end, 1, PROTOCOL_FIELDS_ALL, &message->record.sample) != end)
+		{
+			return PROTOCOL_ERROR_FRAMING;
+		}
+		message->key = 1;
+		message->fields = PROTOCOL_FIELDS_ALL;
+		return PROTOCOL_RECORD;
+	}
+	if (message->type != PROTOCOL_SAMPLE || p == end)
+	{
+		stream->synchronised = 0;
+		return PROTOCOL_ERROR_FRAMING;
+	}
+
+	uint8_t fields = *p++;
+	message->key = (fields & PROTOCOL_KEY) != 0;
+	message->fields = fields & PROTOCOL_FIELDS_ALL;
+	if (!message->key && !stream->synchronised)
+	{
+		return PROTOCOL_ERROR_NO_KEY;
+	}
+
+	ProtocolSample sample;
+	if (message->key)
+	{
+		memset(&sample, 0, sizeof(sample));
+	}
+	else
+	{
+		sample = stream->previous;
+	}
+
+	p = getSample(p, end, message->key, message->fields, &sample);
+	if (p != end)
+	{
+		stream->synchronised = 0;
+		return PROTOCOL_ERROR_FRAMING;
+	}
+
+	stream->previous = sample;
+	stream->synchronised = 1;
+	message->sample = sample;
+	return PROTOCOL_SAMPLE;
+}
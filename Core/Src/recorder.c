@@ -0,0 +1,245 @@
+/**
+ * @brief  Flight recorder of the last seconds of sensor and actuator values.
+ *
+ * Every behaviour step writes one record of fixed size into a ring in RAM: the filtered scan
+ * it was based on, the encoder ticks, the PWM compare values with their direction and the
+ * task with its sub-state. Writing a record is a fixed sequence of stores without loops over
+ * the history, so it costs the same few cycles in every step.
+ *
+ * A trigger (line lost, finish, command) lets the recorder run for RECORDER_POST_TRIGGER more
+ * records and then freezes it, so the ring holds the seconds before the event and the reaction
+ * to it. Error_Handler() freezes it at once and sends it with the interrupts disabled. Otherwise
+ * the command "recorder dump" sends the frozen ring as record frames of the telemetry, oldest
+ * first, and pauses the samples until the dump is complete. Host/decode writes them with -r.
+ *
+ * @author Lukas Probst
+ */
+
+#include <string.h>
+
+#include "main.h"
+#include "usart.h"
+#include "tasks.h"
+#include "telemetry.h"
+#include "recorder.h"
+#include "robot.h"
+
+#define RECORDER_MASK (RECORDER_RECORDS - 1)
+
+/* Timeout of a blocking transfer in ms */
+#define BLOCKING_TIMEOUT 100
+
+/**
+ * @brief  Clears the recorder and starts recording until the next trigger.
+ *
+ * @param  recorder flight recorder
+ * @return None
+ */
+void recorder_arm(Recorder* recorder)
+{
+	recorder->count = 0;
+	recorder->trigger_count = 0;
+	recorder->remaining = 0;
+	recorder->trigger = RECORDER_NONE;
+	recorder->dump_index = -1;
+	recorder->frozen = 0;
+}
+
+/**
+ * @brief  State within the current task.
+ */
+static uint8_t subState(const RobotContext* robot)
+{
+	switch (robot->current_state)
+	{
+		case FOLLOW_TRAJECTORY:
+			return robot->tasks.yellow_trajectory_state;
+		case SEARCH_LINE:
+			return robot->tasks.search_line_state;
+		case AVOID_OBSTACLE:
+			return robot->tasks.avoid_obstacle_state;
+		case CALIBRATE_LINE:
+			return robot->tasks.calibrate_line_state;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * @brief  Writes the record of a behaviour step, unless the recorder is frozen.
+ *
+ * @param  robot state of the robot
+ * @param  frame snapshot of the sensors the step was based on
+ * @return None
+ */
+void recorder_record(RobotContext* robot, const SensorFrame* frame)
+{
+	Recorder* recorder = &robot->recorder;
+	if (recorder->frozen)
+	{
+		return;
+	}
+
+	RecorderRecord* record = &recorder->records[recorder->count & RECORDER_MASK];
+	record->timestamp = frame->timestamp;
+	memcpy(record->adc, frame->adc, sizeof(record->adc));
+	record->encoder_left = frame->encoder_left_ticks;
+	record->encoder_right = frame->encoder_right_ticks;
+	record->pwm_left = (uint16_t) TIM1->CCR2;
+	record->pwm_right = (uint16_t) TIM1->CCR3;
+	record->state = robot->current_state;
+	record->sub_state = subState(robot);
+
+	/* The output level of the phase pins selects the direction of the motors */
+	record->direction = ((GPIOA->ODR & phase2_L_Pin) ? RECORDER_LEFT_BACKWARDS : 0)
+			| ((GPIOB->ODR & phase2_R_Pin) ? RECORDER_RIGHT_BACKWARDS : 0);
+
+	recorder->count++;
+	if (recorder->trigger != RECORDER_NONE && --recorder->remaining == 0)
+	{
+		recorder->frozen = 1;
+	}
+}
+
+/**
+ * @brief  Freezes the recorder after RECORDER_POST_TRIGGER more records. Only the first
+ * 		   trigger after arming counts.
+ *
+ * @param  recorder flight recorder
+ * @param  trigger reason of the trigger
+ * @return None
+ */
+void recorder_trigger(Recorder* recorder, RecorderTrigger trigger)
+{
+	if (recorder->trigger != RECORDER_NONE || recorder->frozen)
+	{
+		return;
+	}
+	recorder->trigger_count = recorder->count;
+	recorder->remaining = RECORDER_POST_TRIGGER;
+	recorder->trigger = trigger;
+}
+
+/**
+ * @brief  Freezes the recorder at once, e.g. on an error or before a dump.
+ *
+ * @param  recorder flight recorder
+ * @param  trigger reason, kept from an earlier trigger that is still recording
+ * @return None
+ */
+void recorder_freeze(Recorder* recorder, RecorderTrigger trigger)
+{
+	if (recorder->frozen)
+	{
+		return;
+	}
+	recorder->frozen = 1;
+	if (recorder->trigger == RECORDER_NONE)
+	{
+		recorder->trigger_count = recorder->count;
+		recorder->trigger = trigger;
+	}
+}
+
+/**
+ * @brief  Number of records in the ring.
+ */
+static uint32_t available(const Recorder* recorder)
+{
+	return recorder->count < RECORDER_RECORDS ? recorder->count : RECORDER_RECORDS;
+}
+
+/**
+ * @brief  Converts the record with the given index since the oldest one.
+ */
+static void toProtocol(const Recorder* recorder, uint32_t index, ProtocolRecord* out)
+{
+	uint32_t number = recorder->count - available(recorder) + index;
+	const RecorderRecord* record = &recorder->records[number & RECORDER_MASK];
+
+	out->trigger = recorder->trigger;
+	out->sub_state = record->sub_state;
+	out->position = (int32_t) (number - recorder->trigger_count);
+	out->sample.timestamp = record->timestamp;
+	for (int i = 0; i < ADC_CHANNELS; i++)
+	{
+		out->sample.adc[i] = record->adc[i];
+	}
+	out->sample.encoder_left = record->encoder_left;
+	out->sample.encoder_right = record->encoder_right;
+	out->sample.state = record->state;
+	out->sample.pwm_left = (record->direction & RECORDER_LEFT_BACKWARDS) ? -(int32_t) record->pwm_left : record->pwm_left;
+	out->sample.pwm_right = (record->direction & RECORDER_RIGHT_BACKWARDS) ? -(int32_t) record->pwm_right : record->pwm_right;
+}
+
+/**
+ * @brief  Freezes the recorder and starts sending its records with recorder_poll().
+ *
+ * @param  recorder flight recorder
+ * @return number of records that will be sent
+ */
+uint32_t recorder_startDump(Recorder* recorder)
+{
+	recorder_freeze(recorder, RECORDER_COMMAND);
+	recorder->dump_index = 0;
+	return available(recorder);
+}
+
+/**
+ * @brief  Sends the next records of a running dump, as many as fit into the telemetry ring.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void recorder_poll(RobotContext* robot)
+{
+	Recorder* recorder = &robot->recorder;
+	while (recorder->dump_index >= 0)
+	{
+		if ((uint32_t) recorder->dump_index == available(recorder))
+		{
+			recorder->dump_index = -1;
+			break;
+		}
+
+		/* The rest is sent on the next call when the ring has room again */
+		if (telemetry_free(&robot->telemetry) < PROTOCOL_MAX_RECORD_FRAME)
+		{
+			break;
+		}
+
+		ProtocolRecord record;
+		uint8_t frame[PROTOCOL_MAX_FRAME];
+		toProtocol(recorder, recorder->dump_index, &record);
+		telemetry_write(&robot->telemetry, frame, protocol_encodeRecord(&robot->telemetry.stream, &record, frame));
+		recorder->dump_index++;
+	}
+}
+
+/**
+ * @brief  Sends all records with the UART in polling mode, for Error_Handler() when the
+ * 		   interrupts are disabled. The transfer of the telemetry is aborted.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void recorder_dumpBlocking(RobotContext* robot)
+{
+	Recorder* recorder = &robot->recorder;
+
+	/* Nothing was recorded if the error happened during the start-up */
+	if (recorder->count == 0)
+	{
+		return;
+	}
+
+	HAL_UART_AbortTransmit(&huart2);
+	for (uint32_t i = 0; i < available(recorder); i++)
+	{
+		ProtocolRecord record;
+		uint8_t frame[PROTOCOL_MAX_FRAME];
+		toProtocol(recorder, i, &record);
+		uint32_t len = protocol_encodeRecord(&robot->telemetry.stream, &record, frame);
+		HAL_UART_Transmit(&huart2, frame, len, BLOCKING_TIMEOUT);
+	}
+}
@@ -0,0 +1,152 @@
+/**
+ * @brief  State and behaviour of the robot, independent of the start-up of the microcontroller.
+ *
+ * main.c configures the clock and the peripherals and then only schedules the functions of
+ * this file, so they can also be built on the host against a stand-in of the HAL.
+ *
+ * @author Lukas Probst
+ */
+
+#include <string.h>
+
+#include "adc.h"
+#include "tim.h"
+#include "sensors.h"
+#include "encoder.h"
+#include "events.h"
+#include "tasks.h"
+#include "utility.h"
+#include "driving.h"
+#include "velocity.h"
+#include "odometry.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "command.h"
+#include "recorder.h"
+#include "calibration.h"
+#include "robot.h"
+
+ROBOT_THREAD_LOCAL RobotContext* robot_active = NULL;
+
+/**
+ * @brief  Sets the initial properties and starts the peripherals.
+ *
+ * The interrupts of the peripherals work on the robot from now on.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void robot_init(RobotContext* robot)
+{
+	memset(robot, 0, sizeof(*robot));
+	robot->params = default_params;
+	calibration_init(&robot->calibration, &robot->params);
+	robot_active = robot;
+	telemetry_init(&robot->telemetry, PROTOCOL_FIELDS_ALL);
+	recorder_arm(&robot->recorder);
+
+	resetEncoderCnt(robot);
+
+	/*
+	 * The acquisition runs on its own from now on: TIM6 triggers a scan of all channels at a
+	 * fixed rate and the DMA writes it into the buffer in circular mode.
+	 */
+	initSensorFilters(robot);
+#ifdef ENCODER_COMPARATORS
+	encoder_init(robot);
+#endif
+#ifdef ADC_WATCHDOGS
+	events_init(robot);
+#endif
+	HAL_ADCEx_Calibration_Start(&hadc1, ADC_SINGLE_ENDED);
+	HAL_TIM_Base_Start(&htim2);
+	HAL_ADC_Start_DMA(&hadc1, robot->sensors.buffer, ADC_DMA_FRAMES * ADC_CHANNELS);
+	HAL_TIM_Base_Start(&htim6);
+
+	/* The generation of PWM signals must be activated */
+	HAL_TIMEx_PWMN_Start(&htim1, TIM_CHANNEL_2);
+	HAL_TIMEx_PWMN_Start(&htim1, TIM_CHANNEL_3);
+
+	resetOdometry(robot);
+	initVelocityControl(robot);
+	setNormalSpeed(robot);
+
+	robot->current_state = FOLLOW_TRAJECTORY;
+	if (robot->params.line_calibration)
+	{
+		task_switch(robot, CALIBRATE_LINE);
+	}
+
+	/* Commands are received in the background from now on */
+	command_init(robot);
+}
+
+/**
+ * @brief  Runs one step of the current task of the race.
+ *
+ * All decisions of one step are based on the same snapshot of the sensors, which is written
+ * to the flight recorder together with the outputs of the step.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void robot_step(RobotContext* robot)
+{
+	SensorFrame frame;
+	getSensorFrame(robot, &frame);
+	updateEncoderCnt(robot, &frame);
+	getPose(robot, &robot->pose);
+	calibration_lineReflectance(&robot->calibration, &frame, robot->line_reflectance);
+	detectColour(robot, &frame);
+
+	/* Check if power switch is activated before starting the robot-routine (prevents driving when it is still connected via USB) */
+	if (frame.adc[CH_BATTERY])
+	{
+		switch (robot->current_state)
+		{
+			case FOLLOW_TRAJECTORY:
+				task_followTrajectory(robot);
+				break;
+			case FOLLOW_LINE:
+				task_followLine(robot);
+				break;
+			case SEARCH_LINE:
+				task_searchLine(robot);
+				break;
+			case AVOID_OBSTACLE:
+				task_avoidObstacle(robot);
+				break;
+			case FINISH_LINE:
+				task_finishLine(robot);
+				break;
+			case CALIBRATE_LINE:
+				task_calibrateLine(robot, &frame);
+				break;
+		}
+	}
+
+	latency_decision(robot, &frame);
+	recorder_record(robot, &frame);
+}
+
+/**
+ * @brief  Sends the latest sensor values, the latency statistics and the calibration to the
+ * 		   computer, unless the telemetry was stopped by a command or the flight recorder is
+ * 		   being dumped.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void robot_outputTelemetry(RobotContext* robot)
+{
+	if (!robot->telemetry.enabled || robot->recorder.dump_index >= 0)
+	{
+		return;
+	}
+
+	SensorFrame frame;
+	getSensorFrame(robot, &frame);
+	outputSensor(robot, &frame);
+	latency_report(robot);
+	calibration_report(robot);
+}
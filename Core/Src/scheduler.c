@@ -0,0 +1,67 @@
+/**
+ * @brief  Fixed-rate cooperative scheduler for the jobs of the main context.
+ *
+ * Every job is released at a multiple of its period on the 1 ms SysTick, independent of how
+ * long the other jobs take. Jobs run to completion in the order of the table, so an earlier
+ * entry has priority if several are due at once. While no job is due the CPU sleeps until the
+ * next interrupt. The time-critical work does not go through the scheduler: the acquisition is
+ * triggered by TIM6 and the velocity control runs in the TIM7 interrupt.
+ *
+ * @author Lukas Probst
+ */
+
+#include "utility.h"
+#include "scheduler.h"
+
+/**
+ * @brief  Runs the jobs forever.
+ *
+ * A job that is still not done when its next release is due has overrun. The missed releases
+ * are counted and skipped instead of being caught up in a burst, so the job continues at its
+ * normal rate from the current tick.
+ *
+ * @param  jobs table of the jobs
+ * @param  count number of jobs
+ * @return None
+ */
+void scheduler_run(Job* jobs, uint32_t count)
+{
+	uint32_t now = HAL_GetTick();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		jobs[i].next_release = now;
+		jobs[i].overruns = 0;
+		jobs[i].max_duration = 0;
+	}
+
+	while (1)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Job* job = &jobs[i];
+			if ((int32_t) (HAL_GetTick() - job->next_release) < 0)
+			{
+				continue;
+			}
+
+			uint32_t start = getMicros();
+			job->run();
+			uint32_t duration = getMicros() - start;
+			if (duration > job->max_duration)
+			{
+				job->max_duration = duration;
+			}
+
+			job->next_release += job->period;
+			now = HAL_GetTick();
+			if ((int32_t) (now - job->next_release) >= 0)
+			{
+				job->overruns += (now - job->next_release) / job->period + 1;
+				job->next_release = now + job->period;
+			}
+		}
+
+		/* Sleep until the next interrupt, at the latest the next SysTick */
+		__WFI();
+	}
+}
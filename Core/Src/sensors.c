@@ -4,117 +4,335 @@
  * @author Lukas Probst
  */
 
-#include <stdio.h>
-
-#include "usart.h"
+#include "tim.h"
 #include "sensors.h"
+#include "filter.h"
+#include "encoder.h"
+#include "calibration.h"
+#include "utility.h"
+#include "telemetry.h"
+#include "robot.h"
+#include "profiler.h"
 
-/* Schmitt trigger thresholds for the wheel encoders */
-#define LEFT_HIGH_THRESHOLD  2500
-#define LEFT_LOW_THRESHOLD   1000
-#define RIGHT_HIGH_THRESHOLD 2750
-#define RIGHT_LOW_THRESHOLD  1000
+/* Time between two scans of the ADC in us */
+#define ADC_SCAN_PERIOD_US (1000000 / ADC_SAMPLE_RATE_HZ)
 
-/* Threshold to detect black with the brightness sensors */
-#define BLACK_LOW_THRESHOLD 2500
+/*
+ * Digital filter of each channel on top of the hardware oversampling. The line sensors are
+ * smoothed the most, the encoders only lightly so that their edges stay sharp.
+ */
+static const struct
+{
+	FilterType type;
+	uint8_t shift;
+} filter_config[ADC_CHANNELS] =
+{
+	[CH_LINESENSOR_MIDDLE] = {FILTER_IIR, 2},
+	[CH_ENCODER_LEFT]      = {FILTER_MOVING_AVERAGE, 1},
+	[CH_LINESENSOR_RIGHT]  = {FILTER_IIR, 2},
+	[CH_BATTERY]           = {FILTER_IIR, 6},
+	[CH_ENCODER_RIGHT]     = {FILTER_MOVING_AVERAGE, 1},
+	[CH_LINESENSOR_LEFT]   = {FILTER_IIR, 2},
+};
 
-typedef enum {LOW, HIGH} Threshold;
-Threshold threshold_left_state;
-Threshold threshold_right_state;
+/**
+ * @brief  Sends real-time data of the sensors, the state and the motor outputs over a UART
+ * 	    interface of the microcontroller to the computer via USB.
+ *
+ * The sample frame is only queued, the transmission itself runs in the background via DMA.
+ *
+ * @param  robot state of the robot
+ * @param  frame snapshot of the sensors
+ * @return None
+ */
+void outputSensor(RobotContext* robot, const SensorFrame* frame)
+{
+	ProtocolSample sample;
+	sample.timestamp = frame->timestamp;
+	for (int i = 0; i < ADC_CHANNELS; i++)
+	{
+		sample.adc[i] = frame->adc[i];
+	}
+	sample.encoder_left = frame->encoder_left_ticks;
+	sample.encoder_right = frame->encoder_right_ticks;
+	sample.state = robot->current_state;
+
+	/* The output level of the phase pins selects the direction of the motors */
+	sample.pwm_left = (GPIOA->ODR & phase2_L_Pin) ? -(int32_t) TIM1->CCR2 : (int32_t) TIM1->CCR2;
+	sample.pwm_right = (GPIOB->ODR & phase2_R_Pin) ? -(int32_t) TIM1->CCR3 : (int32_t) TIM1->CCR3;
+
+	telemetry_sendSample(&robot->telemetry, &sample);
+}
+
+/**
+ * @brief  Sets up the digital filter of every channel.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void initSensorFilters(RobotContext* robot)
+{
+	for (int i = 0; i < ADC_CHANNELS; i++)
+	{
+		filter_init(&robot->sensors.filters[i], filter_config[i].type, filter_config[i].shift, 0);
+	}
+}
 
 /**
- * @brief  Sends real-time data of the sensors over a UART interface of the
- * 	    microcontroller to the computer via USB.
+ * @brief  Processes a contiguous block of scans that the DMA has finished writing.
+ *
+ * Every scan of the block is filtered, the envelopes of the encoders are tracked and the
+ * encoder edges are detected in it, or taken from the hardware counters with
+ * ENCODER_COMPARATORS or the queue of the analog watchdogs with ADC_WATCHDOGS. Afterwards
+ * the last filtered scan is published as the latest frame.
+ *
+ * @param  robot state of the robot
+ * @param  block first scan of the block
+ * @param  frames number of scans in the block
  * @return None
  */
-void outputSensor()
+static void processBlock(RobotContext* robot, const uint32_t* block, uint32_t frames)
 {
-	char string_buf[100];
-	uint32_t len = sprintf((char*) string_buf, "%lu,%lu,%lu,%lu,%lu,%lu\n", adc[0], adc[1], adc[2], adc[3], adc[4], adc[5]);
-	HAL_UART_Transmit(&huart2,(uint8_t*) string_buf, len, 1000000);;
+	PROFILE_ZONE(PROFILE_ADC_BLOCK);
+	Sensors* sensors = &robot->sensors;
+	uint32_t latest[ADC_CHANNELS];
+
+	/* The scans of the block were taken at the fixed rate of TIM6, the last one just now */
+	uint32_t timestamp = getMicros();
+
+	for (uint32_t f = 0; f < frames; f++)
+	{
+		const uint32_t* scan = &block[f * ADC_CHANNELS];
+		for (int i = 0; i < ADC_CHANNELS; i++)
+		{
+			latest[i] = filter_update(&sensors->filters[i], scan[i]);
+		}
+		calibration_trackEncoder(&robot->calibration.left, latest[CH_ENCODER_LEFT],
+				&robot->params.encoder_left_low, &robot->params.encoder_left_high, robot->params.encoder_calibration);
+		calibration_trackEncoder(&robot->calibration.right, latest[CH_ENCODER_RIGHT],
+				&robot->params.encoder_right_low, &robot->params.encoder_right_high, robot->params.encoder_calibration);
+#if !defined(ENCODER_COMPARATORS) && !defined(ADC_WATCHDOGS)
+		SchmittTrigger(robot, latest, timestamp - (frames - 1 - f) * ADC_SCAN_PERIOD_US);
+#endif
+	}
+#ifdef ENCODER_COMPARATORS
+	encoder_update(robot, timestamp);
+#endif
+#ifdef ADC_WATCHDOGS
+	events_process(robot);
+#endif
+
+	/* Publish the new frame */
+	sensors->frame_lock++;
+	__DMB();
+	sensors->published_frame.sequence++;
+	sensors->published_frame.timestamp = timestamp;
+	for (int i = 0; i < ADC_CHANNELS; i++)
+	{
+		sensors->published_frame.adc[i] = latest[i];
+	}
+	sensors->published_frame.encoder_left_ticks = sensors->encoder_left_ticks;
+	sensors->published_frame.encoder_right_ticks = sensors->encoder_right_ticks;
+	sensors->published_frame.edge_left_timestamp = sensors->edge_left_timestamp;
+	sensors->published_frame.edge_right_timestamp = sensors->edge_right_timestamp;
+	sensors->published_frame.edge_left_interval = sensors->edge_left_interval;
+	sensors->published_frame.edge_right_interval = sensors->edge_right_interval;
+#ifdef ADC_WATCHDOGS
+	sensors->published_frame.line_quiet = sensors->line_quiet;
+#endif
+	__DMB();
+	sensors->frame_lock++;
+}
+
+/**
+ * @brief  Takes a snapshot of the latest sensor frame.
+ *
+ * All values of the snapshot belong to the same ADC block. The copy is retried if the ADC
+ * interrupt published a new frame meanwhile, so the interrupts never have to be disabled.
+ *
+ * @param  robot state of the robot
+ * @param  frame receives the snapshot
+ * @return None
+ */
+void getSensorFrame(RobotContext* robot, SensorFrame* frame)
+{
+	Sensors* sensors = &robot->sensors;
+	uint32_t lock;
+	do
+	{
+		lock = sensors->frame_lock;
+		__DMB();
+		*frame = sensors->published_frame;
+		__DMB();
+	}
+	while ((lock & 1) != 0 || lock != sensors->frame_lock);
+}
+
+/**
+ * @brief  Called when the DMA has filled the first half of the buffer, which is processed
+ * 		   while the second half is being written.
+ *
+ * @param  hadc1 ADC handle structure
+ * @return None
+ */
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc1)
+{
+	(void) hadc1;
+	processBlock(robot_active, &robot_active->sensors.buffer[0], ADC_DMA_FRAMES / 2);
 }
 
 /**
  * @brief  When the conversion is complete, this function is called, which must be in the main function.
  *
+ * The conversions are triggered by TIM6, so together with the half transfer callback this
+ * runs at the fixed rate ADC_SAMPLE_RATE_HZ / (ADC_DMA_FRAMES / 2). The encoder edges are
+ * therefore detected here and not in the main loop.
+ *
  * @param  hadc1 ADC handle structure
  * @return None
  */
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc1)
 {
-	for (int i = 0; i < 6; i++)
-	{
-		adc[i] = buffer[i];
-	}
-	outputSensor();
+	(void) hadc1;
+	processBlock(robot_active, &robot_active->sensors.buffer[(ADC_DMA_FRAMES / 2) * ADC_CHANNELS], ADC_DMA_FRAMES / 2);
+}
+
+/**
+ * @brief  Direction in which a wheel is driven.
+ *
+ * The encoders only see the stripes pass by, so the direction is taken from the phase2 output
+ * that drive() sets. A wheel that still coasts after a change of direction is counted in the
+ * new direction.
+ *
+ * @param  port GPIO port of the phase2 pin
+ * @param  pin phase2 pin of the motor
+ * @return 1 forwards, -1 backwards
+ */
+static inline int32_t encoderDirection(GPIO_TypeDef* port, uint16_t pin)
+{
+	return (port->ODR & pin) ? -1 : 1;
+}
+
+/**
+ * @brief  Remembers the time of an encoder edge and the interval since the previous one.
+ *
+ * @param  last_edge time of the latest edge of the encoder, updated
+ * @param  interval interval between the two latest edges, updated
+ * @param  seen whether the encoder had an edge before, updated
+ * @param  timestamp time of the edge in us
+ * @return None
+ */
+void recordEncoderEdge(uint32_t* last_edge, uint32_t* interval, uint8_t* seen, uint32_t timestamp)
+{
+	/* The first edge has no predecessor, the time itself can be 0 after a wrap-around */
+	*interval = *seen ? timestamp - *last_edge : 0;
+	*last_edge = timestamp;
+	*seen = 1;
 }
 
 /**
  * @brief  Converts the encoder values into digital signals with Schmitt trigger.
  *
  * Threshold values for "low" (white) and "high" (black) are used to detect the
- * current encoder signals.
+ * current encoder signals. Every edge counts one tick in the commanded direction of the wheel
+ * and is stamped with the time of its scan.
  *
+ * @param  robot state of the robot
+ * @param  frame one scan of all ADC channels
+ * @param  timestamp time of the scan in us
  * @return None
  */
-void SchmittTrigger()
+void SchmittTrigger(RobotContext* robot, const uint32_t* frame, uint32_t timestamp)
 {
+	PROFILE_ZONE(PROFILE_SCHMITT_TRIGGER);
+	Sensors* sensors = &robot->sensors;
+	int32_t direction_left = encoderDirection(phase2_L_GPIO_Port, phase2_L_Pin);
+	int32_t direction_right = encoderDirection(phase2_R_GPIO_Port, phase2_R_Pin);
+
 	/* Schmitt trigger for the left encoder */
-	if (ENCODER_LEFT >= LEFT_HIGH_THRESHOLD && threshold_left_state == LOW)
+	if (frame[CH_ENCODER_LEFT] >= robot->params.encoder_left_high && sensors->threshold_left_state == LOW)
 	{
-		encoder_left_cnt++;
-		threshold_left_state = HIGH;
+		sensors->encoder_left_ticks += direction_left;
+		recordEncoderEdge(&sensors->edge_left_timestamp, &sensors->edge_left_interval, &sensors->edge_left_seen, timestamp);
+		sensors->threshold_left_state = HIGH;
 	}
-	if (ENCODER_LEFT <= LEFT_LOW_THRESHOLD && threshold_left_state == HIGH)
+	if (frame[CH_ENCODER_LEFT] <= robot->params.encoder_left_low && sensors->threshold_left_state == HIGH)
 	{
-		encoder_left_cnt++;
-		threshold_left_state = LOW;
+		sensors->encoder_left_ticks += direction_left;
+		recordEncoderEdge(&sensors->edge_left_timestamp, &sensors->edge_left_interval, &sensors->edge_left_seen, timestamp);
+		sensors->threshold_left_state = LOW;
 	}
 
 	/* Schmitt trigger for the right encoder */
-	if (ENCODER_RIGHT >= RIGHT_HIGH_THRESHOLD && threshold_right_state == LOW)
+	if (frame[CH_ENCODER_RIGHT] >= robot->params.encoder_right_high && sensors->threshold_right_state == LOW)
 	{
-		encoder_right_cnt++;
-		threshold_right_state = HIGH;
+		sensors->encoder_right_ticks += direction_right;
+		recordEncoderEdge(&sensors->edge_right_timestamp, &sensors->edge_right_interval, &sensors->edge_right_seen, timestamp);
+		sensors->threshold_right_state = HIGH;
 	}
-	if (ENCODER_RIGHT <= RIGHT_LOW_THRESHOLD && threshold_right_state == HIGH)
+	if (frame[CH_ENCODER_RIGHT] <= robot->params.encoder_right_low && sensors->threshold_right_state == HIGH)
 	{
-		encoder_right_cnt++;
-		threshold_right_state = LOW;
+		sensors->encoder_right_ticks += direction_right;
+		recordEncoderEdge(&sensors->edge_right_timestamp, &sensors->edge_right_interval, &sensors->edge_right_seen, timestamp);
+		sensors->threshold_right_state = LOW;
 	}
 }
 
 /**
- * @brief  Detects the colour of the three brightness sensors.
+ * @brief  Detects the colour of the three brightness sensors from their reflectances in the
+ * 		   current step.
  *
+ * With ADC_WATCHDOGS the states are kept without comparing as long as the analog watchdog
+ * reports that no sensor turned black.
+ *
+ * @param  robot state of the robot
+ * @param  frame snapshot of the sensors
  * @return None
  */
-void detectColour()
+void detectColour(RobotContext* robot, const SensorFrame* frame)
 {
-	  if (LINESENSOR_LEFT > BLACK_LOW_THRESHOLD)
+	  PROFILE_ZONE(PROFILE_DETECT_COLOUR);
+#ifdef ADC_WATCHDOGS
+	  /* No sensor crossed the black threshold since all were white */
+	  if (frame->line_quiet)
 	  {
-		  left_linesensor_state = BLACK;
+		  return;
+	  }
+#else
+	  (void) frame;
+#endif
+	  if (robot->line_reflectance[LINE_LEFT] < robot->params.black_level)
+	  {
+		  robot->left_linesensor_state = BLACK;
 	  }
 	  else
 	  {
-		  left_linesensor_state = WHITE;
+		  robot->left_linesensor_state = WHITE;
 	  }
 
-	  if (LINESENSOR_MIDDLE > BLACK_LOW_THRESHOLD)
+	  if (robot->line_reflectance[LINE_MIDDLE] < robot->params.black_level)
 	  {
-		  middle_linesensor_state = BLACK;
+		  robot->middle_linesensor_state = BLACK;
 	  }
 	  else
 	  {
-		  middle_linesensor_state = WHITE;
+		  robot->middle_linesensor_state = WHITE;
 	  }
 
-	  if (LINESENSOR_RIGHT > BLACK_LOW_THRESHOLD)
+	  if (robot->line_reflectance[LINE_RIGHT] < robot->params.black_level)
 	  {
-		  right_linesensor_state = BLACK;
+		  robot->right_linesensor_state = BLACK;
 	  }
 	  else
 	  {
-		  right_linesensor_state = WHITE;
+		  robot->right_linesensor_state = WHITE;
+	  }
+#ifdef ADC_WATCHDOGS
+
+	  if (robot->left_linesensor_state == WHITE && robot->middle_linesensor_state == WHITE
+			  && robot->right_linesensor_state == WHITE)
+	  {
+		  events_watchLine(robot);
 	  }
+#endif
 }
@@ -4,169 +4,180 @@
  * @author Lukas Probst
  */
 
-#include <stdio.h>
+#include <math.h>
 
 #include "main.h"
 #include "gpio.h"
 #include "sensors.h"
 #include "utility.h"
 #include "driving.h"
+#include "velocity.h"
+#include "odometry.h"
+#include "recorder.h"
+#include "calibration.h"
+#include "telemetry.h"
+#include "robot.h"
+#include "profiler.h"
 
-/* Enables conversion from encoder ticks to millimetres */
-#define TICKS_TO_MM 0.19
-
-/* Enables conversion from encoder ticks to degree (but it still depends on the driving speed) */
-#define TICKS_TO_DEGREE 0.13
-
-/* Properties of the sections of the yellow trajectory in the parkour */
-#define FIRST_STRAIGHT_LENGTH  470
-#define RIGHT_CURVE_DEGREE     150
-#define SECOND_STRAIGHT_LENGTH 355
-#define LEFT_CURVE_DEGREE      90
-#define THIRD_STRAIGHT_LENGTH  320
-
-/* Properties to check perimeter for line */
-#define HALF_PERIMETER_DEGREE 100
-#define NEXT_PERIMETER_LENGTH 80
-
-/* Properties to avoid obstacle */
-#define OBSTACLE_REVERSE_LENGTH 25
-#define OBSTACLE_TURN_DEGREE    55
-
-/* After the obstacle has been overcome, this indicates that the robot is on the last part of the course */
-#define LAST_PART_INDICATION 75
-
-/* Time until the robot eventually stops */
-#define FINISH_LINE_SPURT 100
-
-typedef enum {FIRST_STRAIGHT, SECOND_STRAIGHT, THIRD_STRAIGHT, RIGHT_CURVE, LEFT_CURVE, FINISHED} YellowTrajectory;
-YellowTrajectory yellow_trajectory_state = FIRST_STRAIGHT;
-
-typedef enum {LEFT, RIGHT, CENTER, DRIVE_FORWARD} SearchLine;
-SearchLine search_line_state = LEFT;
+/**
+ * @brief  Starts a new section of a manoeuvre at the current pose.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+static void startSegment(RobotContext* robot)
+{
+	resetEncoderCnt(robot);
+	robot->tasks.segment_start = robot->pose;
+}
 
-typedef enum {REVERSE, TURN, CIRCUIT} AvoidObstacle;
-AvoidObstacle avoid_obstacle_state = REVERSE;
+/**
+ * @brief  Distance the robot has driven in the current section.
+ *
+ * @param  robot state of the robot
+ * @return distance in mm
+ */
+static float segmentDistance(RobotContext* robot)
+{
+	return fabsf(robot->pose.distance - robot->tasks.segment_start.distance);
+}
 
-uint8_t perimeter_checked = 0;
-int8_t obstacle_passed = 0;
+/**
+ * @brief  Angle the robot has turned in the current section.
+ *
+ * @param  robot state of the robot
+ * @return angle in degree
+ */
+static float segmentAngle(RobotContext* robot)
+{
+	return fabsf(robot->pose.theta - robot->tasks.segment_start.theta) * (180.0f / (float) M_PI);
+}
 
 /**
  * @brief  The robot follows a fixed trajectory.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void task_followTrajectory()
+void task_followTrajectory(RobotContext* robot)
 {
-	switch (yellow_trajectory_state)
+	PROFILE_ZONE(PROFILE_FOLLOW_TRAJECTORY);
+
+	switch (robot->tasks.yellow_trajectory_state)
 	{
 		case FIRST_STRAIGHT:
-			if (encoder_left_cnt <= FIRST_STRAIGHT_LENGTH * TICKS_TO_MM)
+			if (segmentDistance(robot) <= robot->params.first_straight_length)
 			{
-				driveForward();
+				driveForward(robot);
 			}
 			else
 			{
-				resetEncoderCnt();
-				yellow_trajectory_state = RIGHT_CURVE;
+				startSegment(robot);
+				robot->tasks.yellow_trajectory_state = RIGHT_CURVE;
 			}
 			break;
 		case RIGHT_CURVE:
-			if (encoder_left_cnt <= RIGHT_CURVE_DEGREE * TICKS_TO_DEGREE)
+			if (segmentAngle(robot) <= robot->params.right_curve_degree)
 			{
-				drive(0.5, -0.5);
+				setWheelVelocity(robot, Q16(150), Q16(-150));
 			}
 			else
 			{
-				resetEncoderCnt();
-				yellow_trajectory_state = SECOND_STRAIGHT;
+				startSegment(robot);
+				robot->tasks.yellow_trajectory_state = SECOND_STRAIGHT;
 			}
 			break;
 		case SECOND_STRAIGHT:
-			if (encoder_left_cnt <= SECOND_STRAIGHT_LENGTH * TICKS_TO_MM)
+			if (segmentDistance(robot) <= robot->params.second_straight_length)
 			{
-				setNormalSpeed();
-				driveForward();
+				setNormalSpeed(robot);
+				driveForward(robot);
 			}
 			else
 			{
-				resetEncoderCnt();
-				yellow_trajectory_state = LEFT_CURVE;
+				startSegment(robot);
+				robot->tasks.yellow_trajectory_state = LEFT_CURVE;
 			}
 			break;
 		case LEFT_CURVE:
-			if (encoder_left_cnt <= LEFT_CURVE_DEGREE * TICKS_TO_DEGREE)
+			if (segmentAngle(robot) <= robot->params.left_curve_degree)
 			{
-				drive(-0.5, 0.5);
+				setWheelVelocity(robot, Q16(-150), Q16(150));
 			}
 			else
 			{
-				resetEncoderCnt();
-				yellow_trajectory_state = THIRD_STRAIGHT;
+				startSegment(robot);
+				robot->tasks.yellow_trajectory_state = THIRD_STRAIGHT;
 			}
 			break;
 		case THIRD_STRAIGHT:
-			if (encoder_left_cnt <= THIRD_STRAIGHT_LENGTH * TICKS_TO_MM)
+			if (segmentDistance(robot) <= robot->params.third_straight_length)
 			{
-				setNormalSpeed();
-				driveForward();
+				setNormalSpeed(robot);
+				driveForward(robot);
 			}
 			else
 			{
-				resetEncoderCnt();
-				drive(0, 0);
-				yellow_trajectory_state = FINISHED;
+				startSegment(robot);
+				setWheelVelocity(robot, 0, 0);
+				robot->tasks.yellow_trajectory_state = FINISHED;
 			}
 			break;
 		/* Trajectory completed */
 		case FINISHED:
-			resetEncoderCnt();
-			current_state = FOLLOW_LINE;
+			startSegment(robot);
+			robot->current_state = FOLLOW_LINE;
 			break;
 	}
 }
 
 /**
- * @brief  P-controller for line following.
+ * @brief  P-controller for line following on the reflectances of the outer line sensors.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void task_followLine()
+void task_followLine(RobotContext* robot)
 {
-	float proportional_gain = 0.00015f;
-	int32_t error = LINESENSOR_LEFT - LINESENSOR_RIGHT;
+	PROFILE_ZONE(PROFILE_FOLLOW_LINE);
+
+	q16_t error = q16_sub(robot->line_reflectance[LINE_RIGHT], robot->line_reflectance[LINE_LEFT]);
+	q16_t correction = q16_mul(robot->params.line_gain, error);
 
-	drive(speed_left - error * proportional_gain, speed_right + error * proportional_gain);
+	setWheelVelocity(robot, q16_sub(robot->speed_left, correction), q16_add(robot->speed_right, correction));
 
 	/* Check if robot is on the last part of the parkour to prepare for finish line  */
 
-	if (obstacle_passed == 1 && encoder_left_cnt > LAST_PART_INDICATION)
+	if (robot->tasks.obstacle_passed == 1 && segmentDistance(robot) > robot->params.last_part_indication)
 	{
 		/* Here greyish/white indicates that the finish line was reached */
-		if (middle_linesensor_state == WHITE)
+		if (robot->middle_linesensor_state == WHITE)
 		{
-			resetEncoderCnt();
-			setMaxSpeed();
-			driveForward();
-			current_state = FINISH_LINE;
+			startSegment(robot);
+			setMaxSpeed(robot);
+			driveForward(robot);
+			robot->tasks.calibration_saved = 0;
+			robot->current_state = FINISH_LINE;
+			recorder_trigger(&robot->recorder, RECORDER_FINISH);
 		}
 	}
 	else
 	{
 		/* Line lost and robot must first search for the line again */
-		if (left_linesensor_state == WHITE && middle_linesensor_state == WHITE && right_linesensor_state == WHITE)
+		if (robot->left_linesensor_state == WHITE && robot->middle_linesensor_state == WHITE && robot->right_linesensor_state == WHITE)
 		{
-			drive(0, 0);
-			resetEncoderCnt();
-			search_line_state = LEFT;
-			current_state = SEARCH_LINE;
+			setWheelVelocity(robot, 0, 0);
+			startSegment(robot);
+			robot->tasks.search_line_state = LEFT;
+			robot->current_state = SEARCH_LINE;
+			recorder_trigger(&robot->recorder, RECORDER_LINE_LOST);
 		}
 
 		/* Obstacle detected */
 		if (HAL_GPIO_ReadPin(GPIOA, switch_middle_Pin) == 0)
 		{
-			resetEncoderCnt();
-			current_state = AVOID_OBSTACLE;
+			startSegment(robot);
+			robot->current_state = AVOID_OBSTACLE;
 		}
 	}
 }
@@ -180,134 +191,139 @@ void task_followLine()
  * Repeat the steps above, but with the right wheel. If no line is detected on the left or right side,
  * the robot returns to the starting position and begins to overcome a potential gap.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void task_searchLine()
+void task_searchLine(RobotContext* robot)
 {
-	switch (search_line_state)
+	PROFILE_ZONE(PROFILE_SEARCH_LINE);
+
+	switch (robot->tasks.search_line_state)
 	{
 		/* Check left perimeter */
 		case LEFT:
-			if (encoder_left_cnt <= HALF_PERIMETER_DEGREE * TICKS_TO_DEGREE)
+			if (segmentAngle(robot) <= robot->params.half_perimeter_degree)
 			{
-				drive(-0.5, 0.5);
+				setWheelVelocity(robot, Q16(-150), Q16(150));
 			}
 			else
 			{
-				encoder_left_cnt = 0;
-				resetEncoderCnt();
-				search_line_state = CENTER;
+				startSegment(robot);
+				robot->tasks.search_line_state = CENTER;
 			}
 			break;
 		/* Check right perimeter */
 		case RIGHT:
-			if (encoder_left_cnt <= HALF_PERIMETER_DEGREE * TICKS_TO_DEGREE)
+			if (segmentAngle(robot) <= robot->params.half_perimeter_degree)
 			{
-				drive(0.5, -0.5);
+				setWheelVelocity(robot, Q16(150), Q16(-150));
 			}
 			else
 			{
-				resetEncoderCnt();
-				perimeter_checked = 1;
-				search_line_state = CENTER;
+				startSegment(robot);
+				robot->tasks.perimeter_checked = 1;
+				robot->tasks.search_line_state = CENTER;
 			}
 			break;
 		case CENTER:
-			if (perimeter_checked == 1)
+			if (robot->tasks.perimeter_checked == 1)
 			{
 				/* Turn back to initial position from right */
-				if (encoder_left_cnt <= HALF_PERIMETER_DEGREE * TICKS_TO_DEGREE)
+				if (segmentAngle(robot) <= robot->params.half_perimeter_degree)
 				{
-					drive(-0.5, 0.5);
+					setWheelVelocity(robot, Q16(-150), Q16(150));
 				}
 				else
 				{
-					resetEncoderCnt();
-					search_line_state = DRIVE_FORWARD;
+					startSegment(robot);
+					robot->tasks.search_line_state = DRIVE_FORWARD;
 				}
 			}
 			else
 			{
 				/* Turn back to initial position from left */
-				if (encoder_left_cnt <= HALF_PERIMETER_DEGREE * TICKS_TO_DEGREE)
+				if (segmentAngle(robot) <= robot->params.half_perimeter_degree)
 				{
-					drive(0.5, -0.5);
+					setWheelVelocity(robot, Q16(150), Q16(-150));
 				}
 				else
 				{
-					resetEncoderCnt();
-					search_line_state = RIGHT;
+					startSegment(robot);
+					robot->tasks.search_line_state = RIGHT;
 				}
 			}
 			break;
 		/* Drive forward to check next perimeter for line */
 		case DRIVE_FORWARD:
-			if (encoder_left_cnt <= NEXT_PERIMETER_LENGTH * TICKS_TO_MM)
+			if (segmentDistance(robot) <= robot->params.next_perimeter_length)
 			{
-				drive(0.5, 0.5);
+				setWheelVelocity(robot, Q16(150), Q16(150));
 			}
 			else
 			{
-				perimeter_checked = 0;
-				resetEncoderCnt();
-				search_line_state = LEFT;
+				robot->tasks.perimeter_checked = 0;
+				startSegment(robot);
+				robot->tasks.search_line_state = LEFT;
 			}
 			break;
 	}
 
 	/* Constantly check whether the line has been found again */
-	if (left_linesensor_state == BLACK || middle_linesensor_state == BLACK || right_linesensor_state == BLACK)
+	if (robot->left_linesensor_state == BLACK || robot->middle_linesensor_state == BLACK || robot->right_linesensor_state == BLACK)
 	{
-		drive(0, 0);
-		setNormalSpeed();
-		search_line_state = LEFT;
-		current_state = FOLLOW_LINE;
+		setWheelVelocity(robot, 0, 0);
+		setNormalSpeed(robot);
+		robot->tasks.search_line_state = LEFT;
+		robot->current_state = FOLLOW_LINE;
 	}
 }
 
 /**
  * @brief  Circumnavigates the obstacle on the line.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void task_avoidObstacle()
+void task_avoidObstacle(RobotContext* robot)
 {
-	switch (avoid_obstacle_state)
+	PROFILE_ZONE(PROFILE_AVOID_OBSTACLE);
+
+	switch (robot->tasks.avoid_obstacle_state)
 	{
 		case REVERSE:
-			if (encoder_left_cnt <= OBSTACLE_REVERSE_LENGTH * TICKS_TO_MM)
+			if (segmentDistance(robot) <= robot->params.obstacle_reverse_length)
 			{
-				drive(-0.5, -0.5);
+				setWheelVelocity(robot, Q16(-150), Q16(-150));
 			}
 			else
 			{
-				resetEncoderCnt();
-				avoid_obstacle_state = TURN;
+				startSegment(robot);
+				robot->tasks.avoid_obstacle_state = TURN;
 			}
 			break;
 		case TURN:
-			if (encoder_left_cnt <= OBSTACLE_TURN_DEGREE * TICKS_TO_DEGREE)
+			if (segmentAngle(robot) <= robot->params.obstacle_turn_degree)
 			{
-				drive(0.5, -0.5);
+				setWheelVelocity(robot, Q16(150), Q16(-150));
 			}
 			else
 			{
-				resetEncoderCnt();
-				avoid_obstacle_state = CIRCUIT;
+				startSegment(robot);
+				robot->tasks.avoid_obstacle_state = CIRCUIT;
 			}
 			break;
 		case CIRCUIT:
-			if (middle_linesensor_state != BLACK)
+			if (robot->middle_linesensor_state != BLACK)
 			{
-				drive(0.3, 0.55);
+				setWheelVelocity(robot, Q16(90), Q16(165));
 			}
 			else
 			{
-				resetEncoderCnt();
-				setNormalSpeed();
-				avoid_obstacle_state = REVERSE;
-				obstacle_passed = 1;
-				current_state = FOLLOW_LINE;
+				startSegment(robot);
+				setNormalSpeed(robot);
+				robot->tasks.avoid_obstacle_state = REVERSE;
+				robot->tasks.obstacle_passed = 1;
+				robot->current_state = FOLLOW_LINE;
 			}
 			break;
 	}
@@ -316,14 +332,132 @@ void task_avoidObstacle()
 /**
  * @brief  The finish line is reached.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void task_finishLine()
+void task_finishLine(RobotContext* robot)
 {
+	PROFILE_ZONE(PROFILE_FINISH_LINE);
+
 	/* Time until the final spurt is over and the robot comes to a standstill */
-	if (encoder_left_cnt > FINISH_LINE_SPURT * TICKS_TO_MM)
+	if (segmentDistance(robot) > robot->params.finish_line_spurt)
 	{
-		drive(0, 0);
-		blinkAllLEDs();
+		setWheelVelocity(robot, 0, 0);
+		blinkAllLEDs(robot);
+
+		/*
+		 * Saved once per finish, nothing is written if the values did not change since they
+		 * were saved. A failure is only reported, retrying would erase the page every step.
+		 */
+		if (!robot->tasks.calibration_saved && robot->velocity.left.measured == 0 && robot->velocity.right.measured == 0)
+		{
+			robot->tasks.calibration_saved = 1;
+			if (!calibration_save(&robot->calibration, &robot->params))
+			{
+				static const char failed[] = "# calibration save failed\n";
+				telemetry_sendText(&robot->telemetry, failed, sizeof(failed) - 1);
+			}
+		}
+	}
+}
+
+/**
+ * @brief  Measures the levels of the line sensors by a sweep over the line.
+ *
+ * The robot stands on the line and turns on the spot to the left, to the right and back to
+ * its initial heading while the extremes of the line sensors are recorded. The levels are
+ * taken if every sensor saw the floor and the line, otherwise the failure is reported and the
+ * previous levels are kept. Then the race starts with the yellow trajectory. The levels are
+ * saved in the flash at the finish, where the robot stands anyway.
+ *
+ * @param  robot state of the robot
+ * @param  frame snapshot of the sensors of this control step
+ * @return None
+ */
+void task_calibrateLine(RobotContext* robot, const SensorFrame* frame)
+{
+	PROFILE_ZONE(PROFILE_CALIBRATE_LINE);
+
+	calibration_trackLine(&robot->calibration, frame);
+
+	switch (robot->tasks.calibrate_line_state)
+	{
+		case SWEEP_LEFT:
+			if (segmentAngle(robot) <= robot->params.line_sweep_degree)
+			{
+				setWheelVelocity(robot, Q16(-100), Q16(100));
+			}
+			else
+			{
+				startSegment(robot);
+				robot->tasks.calibrate_line_state = SWEEP_RIGHT;
+			}
+			break;
+		case SWEEP_RIGHT:
+			if (segmentAngle(robot) <= 2 * robot->params.line_sweep_degree)
+			{
+				setWheelVelocity(robot, Q16(100), Q16(-100));
+			}
+			else
+			{
+				startSegment(robot);
+				robot->tasks.calibrate_line_state = SWEEP_BACK;
+			}
+			break;
+		case SWEEP_BACK:
+			if (segmentAngle(robot) <= robot->params.line_sweep_degree)
+			{
+				setWheelVelocity(robot, Q16(-100), Q16(100));
+			}
+			else
+			{
+				/* The race continues on the previous levels, but not silently */
+				if (!calibration_finishLineSweep(&robot->calibration))
+				{
+					static const char failed[] = "# calibration line sweep failed\n";
+					telemetry_sendText(&robot->telemetry, failed, sizeof(failed) - 1);
+				}
+				task_switch(robot, FOLLOW_TRAJECTORY);
+			}
+			break;
+	}
+}
+
+/**
+ * @brief  Switches to a task from outside of the race, e.g. by a command.
+ *
+ * The robot stops and the task starts over with its first section at the current pose.
+ *
+ * @param  robot state of the robot
+ * @param  state task to switch to
+ * @return None
+ */
+void task_switch(RobotContext* robot, RaceState state)
+{
+	setWheelVelocity(robot, 0, 0);
+	setNormalSpeed(robot);
+	startSegment(robot);
+
+	switch (state)
+	{
+		case FOLLOW_TRAJECTORY:
+			robot->tasks.yellow_trajectory_state = FIRST_STRAIGHT;
+			break;
+		case SEARCH_LINE:
+			robot->tasks.search_line_state = LEFT;
+			break;
+		case AVOID_OBSTACLE:
+			robot->tasks.avoid_obstacle_state = REVERSE;
+			break;
+		case FINISH_LINE:
+			robot->tasks.calibration_saved = 0;
+			break;
+		case CALIBRATE_LINE:
+			robot->tasks.calibrate_line_state = SWEEP_LEFT;
+			calibration_startLineSweep(&robot->calibration);
+			break;
+		default:
+			break;
 	}
+	robot->current_state = state;
 }
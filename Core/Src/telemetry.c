@@ -0,0 +1,203 @@
+/**
+ * @brief  Non-blocking telemetry output over USART2.
+ *
+ * Frames are copied into a single-producer/single-consumer byte ring and drained in the
+ * background by the USART2 TX DMA channel, so the producer never waits on the serial port.
+ * The producer only advances the head, the DMA completion only advances the tail. A transfer
+ * is started either by the producer or by the USART2 interrupt, so the producer does that
+ * with the interrupts masked.
+ *
+ * Samples and text lines are sent as frames of the binary protocol (see protocol.c).
+ *
+ * @author Lukas Probst
+ */
+
+#include "usart.h"
+#include "telemetry.h"
+#include "command.h"
+#include "robot.h"
+
+#define TELEMETRY_MASK (TELEMETRY_BUFFER_SIZE - 1)
+
+/**
+ * @brief  Starts a DMA transfer of the next contiguous chunk of the ring if the UART is idle.
+ *
+ * @param  telemetry transmit ring
+ * @return None
+ */
+static void telemetry_startTransfer(Telemetry* telemetry)
+{
+	if (telemetry->tx_len != 0)
+	{
+		return;
+	}
+
+	uint32_t start = telemetry->tail & TELEMETRY_MASK;
+	uint32_t pending = telemetry->head - telemetry->tail;
+	if (pending == 0)
+	{
+		return;
+	}
+
+	/* The DMA can only read a contiguous block, the rest follows after the wrap-around */
+	uint32_t len = TELEMETRY_BUFFER_SIZE - start;
+	if (pending < len)
+	{
+		len = pending;
+	}
+
+	telemetry->tx_len = len;
+	if (HAL_UART_Transmit_DMA(&huart2, &telemetry->ring[start], len) != HAL_OK)
+	{
+		telemetry->tx_len = 0;
+	}
+}
+
+/**
+ * @brief  Prepares the ring and the protocol stream.
+ *
+ * @param  telemetry transmit ring
+ * @param  fields fields of the sample frames (PROTOCOL_FIELD_*)
+ * @return None
+ */
+void telemetry_init(Telemetry* telemetry, uint8_t fields)
+{
+	telemetry->head = 0;
+	telemetry->tail = 0;
+	telemetry->tx_len = 0;
+	telemetry->enabled = 1;
+	protocol_init(&telemetry->stream, fields);
+}
+
+/**
+ * @brief  Free space of the transmit ring. It only grows until the next write.
+ *
+ * @param  telemetry transmit ring
+ * @return number of bytes that can be written
+ */
+uint32_t telemetry_free(const Telemetry* telemetry)
+{
+	return TELEMETRY_BUFFER_SIZE - (telemetry->head - telemetry->tail);
+}
+
+/**
+ * @brief  Enqueues a complete frame for transmission.
+ *
+ * The frame is either copied completely or dropped, so the host never receives a torn line.
+ *
+ * @param  telemetry transmit ring
+ * @param  data bytes of the frame
+ * @param  len number of bytes
+ * @return 1 if the frame was queued, 0 if it was dropped because the ring was full
+ */
+uint8_t telemetry_write(Telemetry* telemetry, const uint8_t* data, uint32_t len)
+{
+	uint32_t used = telemetry->head - telemetry->tail;
+	if (len > TELEMETRY_BUFFER_SIZE - used)
+	{
+		telemetry->dropped_frames++;
+		return 0;
+	}
+
+	uint32_t h = telemetry->head;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		telemetry->ring[(h + i) & TELEMETRY_MASK] = data[i];
+	}
+	/* Publish the bytes only after they have been written */
+	__DMB();
+	telemetry->head = h + len;
+
+	used += len;
+	if (used > telemetry->high_water)
+	{
+		telemetry->high_water = used;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	telemetry_startTransfer(telemetry);
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+/**
+ * @brief  Sends a sample frame.
+ *
+ * The next sample frame is a key frame if this one is dropped, so the host can decode it
+ * without the missing differences.
+ *
+ * @param  telemetry transmit ring
+ * @param  sample values to send
+ * @return 1 if the frame was queued, 0 if it was dropped
+ */
+uint8_t telemetry_sendSample(Telemetry* telemetry, const ProtocolSample* sample)
+{
+	uint8_t frame[PROTOCOL_MAX_FRAME];
+	uint32_t len = protocol_encodeSample(&telemetry->stream, sample, frame);
+	if (!telemetry_write(telemetry, frame, len))
+	{
+		protocol_resync(&telemetry->stream);
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief  Sends a line of text, e.g. statistics, as a text frame.
+ *
+ * @param  telemetry transmit ring
+ * @param  text characters of the line
+ * @param  len number of characters
+ * @return 1 if the frame was queued, 0 if it was dropped
+ */
+uint8_t telemetry_sendText(Telemetry* telemetry, const char* text, uint32_t len)
+{
+	uint8_t frame[PROTOCOL_MAX_FRAME];
+	return telemetry_write(telemetry, frame, protocol_encodeText(&telemetry->stream, text, len, frame));
+}
+
+/**
+ * @brief  Called by the HAL when a DMA transfer over USART2 has completed. Releases the
+ * 		   transmitted bytes and continues with the rest of the ring.
+ *
+ * @param  huart UART handle structure
+ * @return None
+ */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
+{
+	if (huart->Instance == USART2)
+	{
+		Telemetry* telemetry = &robot_active->telemetry;
+		telemetry->tail += telemetry->tx_len;
+		telemetry->tx_len = 0;
+		telemetry_startTransfer(telemetry);
+	}
+}
+
+/**
+ * @brief  Called by the HAL when a transfer over USART2 was aborted. The bytes in flight are
+ * 		   still in the ring and are sent again.
+ *
+ * The callback is shared with the reception of commands, whose errors leave a running
+ * transmission alone.
+ *
+ * @param  huart UART handle structure
+ * @return None
+ */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart)
+{
+	if (huart->Instance == USART2)
+	{
+		Telemetry* telemetry = &robot_active->telemetry;
+		if (huart->gState == HAL_UART_STATE_READY)
+		{
+			telemetry->tx_len = 0;
+			telemetry_startTransfer(telemetry);
+		}
+		if (huart->RxState == HAL_UART_STATE_READY)
+		{
+			command_receptionStopped(robot_active);
+		}
+	}
+}
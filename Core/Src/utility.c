@@ -4,111 +4,139 @@
  * @author Lukas Probst
  */
 
-#include <stdio.h>
-
 #include "adc.h"
+#include "tim.h"
 #include "sensors.h"
 #include "driving.h"
+#include "velocity.h"
+#include "utility.h"
+#include "robot.h"
 
-/* Default motor speed */
-#define NORMAL_SPEED_LEFT  0.5
-#define NORMAL_SPEED_RIGHT 0.5
-/* The driving speed is scaled so that it lies in the interval [-1, 1], i.e. 1 is the maximum value */
-#define MAX_SPEED 1
+/* Velocity of the wheels in mm/s for the final spurt */
+#define MAX_SPEED Q16(MAX_WHEEL_VELOCITY)
 
 /* Interval in which an LED blinks */
 #define BLINK_INTERVAL 100
 
-uint32_t last_switch_left = 0;
-uint32_t last_switch_right = 0;
-uint32_t last_switch_tail = 0;
-
 /**
  * @brief  Makes LED2 blink.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void blinkLeftLED()
+void blinkLeftLED(RobotContext* robot)
 {
 	uint32_t time = HAL_GetTick();
-	if (time - last_switch_left >= BLINK_INTERVAL)
+	if (time - robot->last_switch_left >= BLINK_INTERVAL)
 	{
 		HAL_GPIO_TogglePin(LED_left_GPIO_Port, LED_left_Pin);
-		last_switch_left = time;
+		robot->last_switch_left = time;
 	}
 }
 
 /**
  * @brief  Makes LED3 blink.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void blinkRightLED()
+void blinkRightLED(RobotContext* robot)
 {
 	uint32_t time = HAL_GetTick();
-	if (time - last_switch_right >= BLINK_INTERVAL)
+	if (time - robot->last_switch_right >= BLINK_INTERVAL)
 	{
 		HAL_GPIO_TogglePin(LED_right_GPIO_Port, LED_right_Pin);
-		last_switch_right = time;
+		robot->last_switch_right = time;
 	}
 }
 
 /**
  * @brief  Makes LED5 & LED6 (SMD LEDs) blink.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void blinkTailLight()
+void blinkTailLight(RobotContext* robot)
 {
 	uint32_t time = HAL_GetTick();
-	if (time - last_switch_tail >= BLINK_INTERVAL)
+	if (time - robot->last_switch_tail >= BLINK_INTERVAL)
 	{
 		HAL_GPIO_TogglePin(LED_SMD_GPIO_Port, LED_SMD_Pin);
-		last_switch_tail = time;
+		robot->last_switch_tail = time;
 	}
 }
 
 /**
  * @brief  Makes all LEDs blink.
  *
+ * @param  robot state of the robot
  * @return None
  */
-void blinkAllLEDs()
+void blinkAllLEDs(RobotContext* robot)
 {
-	blinkLeftLED();
-	blinkRightLED();
-	blinkTailLight();
+	blinkLeftLED(robot);
+	blinkRightLED(robot);
+	blinkTailLight(robot);
 }
 
 /**
  * @brief  Sets the normal driving speed.
  *
+ * @param  robot state of the robot
  * @return none
  */
-void setNormalSpeed()
+void setNormalSpeed(RobotContext* robot)
 {
-	speed_left = NORMAL_SPEED_LEFT;
-	speed_right = NORMAL_SPEED_RIGHT;
+	robot->speed_left = robot->params.normal_speed;
+	robot->speed_right = robot->params.normal_speed;
 }
 
 /**
  * @brief  Sets the maximum driving speed.
  *
+ * @param  robot state of the robot
  * @return none
  */
-void setMaxSpeed()
+void setMaxSpeed(RobotContext* robot)
 {
-	speed_left = MAX_SPEED;
-	speed_right = MAX_SPEED;
+	robot->speed_left = MAX_SPEED;
+	robot->speed_right = MAX_SPEED;
 }
 
 /**
  * @brief  Resets the encoder count (number of ticks).
  *
+ * @param  robot state of the robot
  * @return none
  */
-void resetEncoderCnt()
+void resetEncoderCnt(RobotContext* robot)
+{
+	robot->encoder_left_origin += robot->encoder_left_cnt;
+	robot->encoder_right_origin += robot->encoder_right_cnt;
+	robot->encoder_left_cnt = 0;
+	robot->encoder_right_cnt = 0;
+}
+
+/**
+ * @brief  Updates the encoder count from a sensor frame, so that it matches the other
+ * 		   sensor values of the same control step.
+ *
+ * @param  robot state of the robot
+ * @param  frame snapshot of the sensors
+ * @return none
+ */
+void updateEncoderCnt(RobotContext* robot, const SensorFrame* frame)
+{
+	robot->encoder_left_cnt = frame->encoder_left_ticks - robot->encoder_left_origin;
+	robot->encoder_right_cnt = frame->encoder_right_ticks - robot->encoder_right_origin;
+}
+
+/**
+ * @brief  Returns the time since the start in microseconds, taken from the free-running TIM2.
+ *
+ * @return time in microseconds
+ */
+uint32_t getMicros()
 {
-	encoder_left_cnt = 0;
-	encoder_right_cnt = 0;
+	return TIM2->CNT;
 }
@@ -0,0 +1,221 @@
+/**
+ * @brief  Closed-loop velocity control of both wheels.
+ *
+ * Each wheel has its own PI(D) controller with feed-forward that turns a target velocity in
+ * mm/s into a duty cycle. The controllers run at a fixed rate in the TIM7 interrupt, the tasks
+ * only set the target velocities.
+ *
+ * The velocity of each wheel is estimated from its signed tick rate within a window of
+ * VELOCITY_WINDOW control periods. At low speed this gives only a few ticks per window and is
+ * badly quantised, so below VELOCITY_COUNT_TICKS the velocity is taken from the time between
+ * the two latest encoder edges instead, with the resolution of an ADC scan. As long as no
+ * new edge arrives, the time since the latest edge bounds the velocity from above, so a
+ * stopping wheel is seen to slow down.
+ *
+ * @author Lukas Probst
+ */
+
+#include "tim.h"
+#include "sensors.h"
+#include "driving.h"
+#include "utility.h"
+#include "velocity.h"
+#include "odometry.h"
+#include "latency.h"
+#include "robot.h"
+
+/* Default gains of the controllers */
+#define VELOCITY_KP  Q16(0.002)
+#define VELOCITY_KI  Q16(0.01)
+#define VELOCITY_KD  0
+#define VELOCITY_KFF Q16(1.0 / MAX_WHEEL_VELOCITY)
+
+/* Velocity that corresponds to one tick within the measurement window */
+#define TICK_VELOCITY Q16(ENCODER_TICK_MM * VELOCITY_CONTROL_RATE_HZ / VELOCITY_WINDOW)
+
+/*
+ * Distance of one tick in mm * us with TICK_DISTANCE_SHIFT fractional bits, so that it fits
+ * 32 bits. Divided by an edge interval in us it gives mm/s with the same fractional bits.
+ */
+#define TICK_DISTANCE_SHIFT 8
+#define TICK_DISTANCE_US    ((uint32_t) (ENCODER_TICK_MM * 1000000.0 * (1 << TICK_DISTANCE_SHIFT)))
+
+/* Largest quotient that still fits Q16.16 after the shift */
+#define TICK_VELOCITY_MAX ((uint32_t) Q16_MAX >> (Q16_SHIFT - TICK_DISTANCE_SHIFT))
+
+/* Integration of the error in mm per control period */
+#define CONTROL_PERIOD Q16(1.0 / VELOCITY_CONTROL_RATE_HZ)
+
+/**
+ * @brief  Resets a controller and sets its default gains.
+ *
+ * @param  controller controller of one wheel
+ * @return None
+ */
+static void initController(WheelController* controller)
+{
+	controller->kp = VELOCITY_KP;
+	controller->ki = VELOCITY_KI;
+	controller->kd = VELOCITY_KD;
+	controller->kff = VELOCITY_KFF;
+	controller->target = 0;
+	controller->measured = 0;
+	controller->integral = 0;
+	controller->previous_error = 0;
+	controller->output = 0;
+	controller->direction = 1;
+}
+
+/**
+ * @brief  Estimates the velocity of one wheel.
+ *
+ * @param  controller controller of the wheel, receives the estimate
+ * @param  window_ticks ticks within the window
+ * @param  step_ticks ticks within the last control period
+ * @param  edge_timestamp time of the latest edge in us
+ * @param  edge_interval time between the two latest edges in us, 0 if unknown
+ * @param  now current time in us
+ * @return None
+ */
+static void estimateVelocity(WheelController* controller, int32_t window_ticks, int32_t step_ticks,
+		uint32_t edge_timestamp, uint32_t edge_interval, uint32_t now)
+{
+	if (step_ticks != 0)
+	{
+		controller->direction = step_ticks > 0 ? 1 : -1;
+	}
+
+	/* Enough ticks for counting */
+	if (window_ticks >= VELOCITY_COUNT_TICKS || window_ticks <= -VELOCITY_COUNT_TICKS)
+	{
+		controller->measured = q16_mulInt(TICK_VELOCITY, window_ticks);
+		return;
+	}
+
+	uint32_t since_edge = now - edge_timestamp;
+	if (edge_interval == 0 || since_edge >= VELOCITY_STOP_US)
+	{
+		controller->measured = 0;
+		return;
+	}
+
+	/* Without a new edge the wheel is at most as fast as if the next one came now */
+	uint32_t period = since_edge > edge_interval ? since_edge : edge_interval;
+	uint32_t quotient = TICK_DISTANCE_US / period;
+	q16_t velocity = quotient > TICK_VELOCITY_MAX ? Q16_MAX : (q16_t) (quotient << (Q16_SHIFT - TICK_DISTANCE_SHIFT));
+	controller->measured = controller->direction > 0 ? velocity : -velocity;
+}
+
+/**
+ * @brief  Computes the new duty cycle of one wheel.
+ *
+ * The integral is only updated if that does not drive the output further into saturation
+ * (conditional integration as anti-windup).
+ *
+ * @param  controller controller of one wheel
+ * @return duty cycle in [-1, 1]
+ */
+static q16_t updateController(WheelController* controller)
+{
+	/* A stopped wheel is not regulated, so that it really stands still */
+	if (controller->target == 0)
+	{
+		controller->integral = 0;
+		controller->previous_error = 0;
+		controller->output = 0;
+		return 0;
+	}
+
+	q16_t error = q16_sub(controller->target, controller->measured);
+	q16_t derivative = q16_sub(error, controller->previous_error);
+	controller->previous_error = error;
+
+	q16_t output = q16_mul(controller->kff, controller->target);
+	output = q16_add(output, q16_mul(controller->kp, error));
+	output = q16_add(output, q16_mul(controller->kd, q16_mulInt(derivative, VELOCITY_CONTROL_RATE_HZ)));
+
+	q16_t integral = q16_add(controller->integral, q16_mul(error, CONTROL_PERIOD));
+	q16_t unsaturated = q16_add(output, q16_mul(controller->ki, integral));
+	if ((unsaturated < Q16_ONE || error < 0) && (unsaturated > -Q16_ONE || error > 0))
+	{
+		controller->integral = integral;
+	}
+
+	output = q16_add(output, q16_mul(controller->ki, controller->integral));
+	controller->output = q16_saturate(output, -Q16_ONE, Q16_ONE);
+	return controller->output;
+}
+
+/**
+ * @brief  Initialises both controllers and starts TIM7.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void initVelocityControl(RobotContext* robot)
+{
+	initController(&robot->velocity.left);
+	initController(&robot->velocity.right);
+	HAL_TIM_Base_Start_IT(&htim7);
+}
+
+/**
+ * @brief  Sets the target velocity of both wheels.
+ *
+ * @param  robot state of the robot
+ * @param  velocity_left target velocity of the left wheel in mm/s
+ * @param  velocity_right target velocity of the right wheel in mm/s
+ * @return None
+ */
+void setWheelVelocity(RobotContext* robot, q16_t velocity_left, q16_t velocity_right)
+{
+	robot->velocity.left.target = velocity_left;
+	robot->velocity.right.target = velocity_right;
+}
+
+/**
+ * @brief  One step of the velocity control: measures the velocity of both wheels, updates
+ * 		   the motor outputs and integrates the odometry.
+ *
+ * @param  robot state of the robot
+ * @return None
+ */
+void velocityControlStep(RobotContext* robot)
+{
+	latency_controlPeriod(robot);
+
+	VelocityControl* control = &robot->velocity;
+	SensorFrame frame;
+	getSensorFrame(robot, &frame);
+	int32_t left = frame.encoder_left_ticks;
+	int32_t right = frame.encoder_right_ticks;
+	uint32_t now = getMicros();
+	uint8_t previous = (control->window_index + VELOCITY_WINDOW - 1) % VELOCITY_WINDOW;
+
+	/* The oldest entry of the window is replaced by the current count */
+	estimateVelocity(&control->left, left - control->ticks_left[control->window_index], left - control->ticks_left[previous],
+			frame.edge_left_timestamp, frame.edge_left_interval, now);
+	estimateVelocity(&control->right, right - control->ticks_right[control->window_index], right - control->ticks_right[previous],
+			frame.edge_right_timestamp, frame.edge_right_interval, now);
+	control->ticks_left[control->window_index] = left;
+	control->ticks_right[control->window_index] = right;
+	control->window_index = (control->window_index + 1) % VELOCITY_WINDOW;
+
+	drive(robot, updateController(&control->left), updateController(&control->right));
+	latency_pwmWritten(robot, frame.timestamp);
+	updateOdometry(robot);
+}
+
+/**
+ * @brief  Called by the HAL when a timer has elapsed.
+ *
+ * @param  htim TIM handle structure
+ * @return None
+ */
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim)
+{
+	if (htim->Instance == TIM7)
+	{
+		velocityControlStep(robot_active);
+	}
+}
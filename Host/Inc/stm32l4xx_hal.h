@@ -0,0 +1,238 @@
+/**
+ * @brief  Host stand-in for the STM32L4 HAL and the CMSIS registers.
+ *
+ * Declares just enough of the HAL for the control modules of the firmware to compile
+ * unchanged on the host. The peripherals are plain structs that hal.c updates along a virtual
+ * clock: the PWM duty can be read from TIM1, GPIO outputs from ODR, GPIO inputs are set in
+ * IDR and the ADC scans are taken from adc_input or a sampler function.
+ *
+ * Every simulated microcontroller is a HalInstance with its own registers and clock. The
+ * register macros resolve to the instance selected in the calling thread, so many instances
+ * can run side by side, in one thread or in several.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __STM32L4XX_HAL_H
+#define __STM32L4XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define STM32L432xx
+
+/* Registers */
+
+typedef struct
+{
+	volatile uint32_t IDR;
+	volatile uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+	volatile uint32_t CNT;
+	volatile uint32_t ARR;
+	volatile uint32_t CCR1;
+	volatile uint32_t CCR2;
+	volatile uint32_t CCR3;
+	volatile uint32_t CCR4;
+} TIM_TypeDef;
+
+typedef struct
+{
+	volatile uint32_t DR;
+} ADC_TypeDef;
+
+typedef struct
+{
+	volatile uint32_t TDR;
+} USART_TypeDef;
+
+/* Simulated microcontroller, see the end of the file */
+typedef struct HalInstance HalInstance;
+
+/* Instance the registers, the HAL functions and the interrupts of the calling thread work on */
+extern __thread HalInstance* hal_current;
+
+#define GPIOA  (&hal_current->gpioa)
+#define GPIOB  (&hal_current->gpiob)
+#define TIM1   (&hal_current->tim1)
+#define TIM2   (&hal_current->tim2)
+#define TIM6   (&hal_current->tim6)
+#define TIM7   (&hal_current->tim7)
+#define ADC1   (&hal_current->adc1)
+#define USART2 (&hal_current->usart2)
+
+/* Core intrinsics, the interrupts of an instance never preempt its main context */
+
+#define __DMB() __sync_synchronize()
+#define __WFI() ((void) 0)
+#define __disable_irq() ((void) 0)
+#define __enable_irq() ((void) 0)
+#define __get_PRIMASK() 0u
+#define __set_PRIMASK(x) ((void) (x))
+
+/* HAL types */
+
+typedef enum {HAL_OK, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT} HAL_StatusTypeDef;
+typedef enum {GPIO_PIN_RESET, GPIO_PIN_SET} GPIO_PinState;
+
+/*
+ * The handles the CubeMX files define are shared by all instances and never written, the
+ * HAL functions recognise them by their address. The callbacks get a handle whose Instance
+ * belongs to the current instance.
+ */
+typedef struct
+{
+	TIM_TypeDef* Instance;
+} TIM_HandleTypeDef;
+
+typedef struct
+{
+	ADC_TypeDef* Instance;
+} ADC_HandleTypeDef;
+
+typedef struct
+{
+	USART_TypeDef* Instance;
+	uint32_t gState;
+	uint32_t RxState;
+} UART_HandleTypeDef;
+
+#define HAL_UART_STATE_READY 0x00000020u
+
+typedef struct
+{
+	void* Instance;
+} DMA_HandleTypeDef;
+
+#define GPIO_PIN_0  ((uint16_t) 0x0001)
+#define GPIO_PIN_1  ((uint16_t) 0x0002)
+#define GPIO_PIN_2  ((uint16_t) 0x0004)
+#define GPIO_PIN_3  ((uint16_t) 0x0008)
+#define GPIO_PIN_4  ((uint16_t) 0x0010)
+#define GPIO_PIN_5  ((uint16_t) 0x0020)
+#define GPIO_PIN_6  ((uint16_t) 0x0040)
+#define GPIO_PIN_7  ((uint16_t) 0x0080)
+#define GPIO_PIN_8  ((uint16_t) 0x0100)
+#define GPIO_PIN_9  ((uint16_t) 0x0200)
+#define GPIO_PIN_10 ((uint16_t) 0x0400)
+#define GPIO_PIN_11 ((uint16_t) 0x0800)
+#define GPIO_PIN_12 ((uint16_t) 0x1000)
+#define GPIO_PIN_13 ((uint16_t) 0x2000)
+#define GPIO_PIN_14 ((uint16_t) 0x4000)
+#define GPIO_PIN_15 ((uint16_t) 0x8000)
+
+#define TIM_CHANNEL_1 0x00000000u
+#define TIM_CHANNEL_2 0x00000004u
+#define TIM_CHANNEL_3 0x00000008u
+#define TIM_CHANNEL_4 0x0000000Cu
+
+#define ADC_SINGLE_ENDED 0x7FFu
+
+/* Flash, only the last page exists, at the address of flash_page of the current instance */
+#define FLASH_PAGE_SIZE 0x800u
+#define HAL_FLASH_PAGES 128u
+#define FLASH_BASE ((uintptr_t) hal_current->flash_page - (HAL_FLASH_PAGES - 1) * FLASH_PAGE_SIZE)
+#define FLASH_TYPEERASE_PAGES 0u
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0u
+#define FLASH_BANK_1 1u
+#define FLASH_FLAG_ALL_ERRORS 0u
+#define __HAL_FLASH_CLEAR_FLAG(flags) ((void) (flags))
+
+typedef struct
+{
+	uint32_t TypeErase;
+	uint32_t Banks;
+	uint32_t Page;
+	uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+/* HAL functions implemented by hal.c */
+
+uint32_t HAL_GetTick(void);
+void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state);
+void HAL_GPIO_TogglePin(GPIO_TypeDef* port, uint16_t pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* port, uint16_t pin);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Start(TIM_HandleTypeDef* htim, uint32_t channel);
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef* hadc, uint32_t single_diff);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* data, uint32_t length);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef* huart);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size);
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* erase, uint32_t* page_error);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t type, uintptr_t address, uint64_t data);
+
+/* Callbacks implemented by the firmware */
+
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc);
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t size);
+
+/* Control of the stand-in */
+
+/* Number of channels in one ADC scan */
+#define HAL_ADC_SCAN_LENGTH 6
+
+struct HalInstance
+{
+	GPIO_TypeDef gpioa;
+	GPIO_TypeDef gpiob;
+	TIM_TypeDef tim1;
+	TIM_TypeDef tim2;
+	TIM_TypeDef tim6;
+	TIM_TypeDef tim7;
+	ADC_TypeDef adc1;
+	USART_TypeDef usart2;
+
+	/* State behind the handles */
+	uint32_t* adc_buffer;
+	uint32_t adc_length;
+	uint32_t adc_index;
+	uint8_t tim6_running;
+	uint8_t tim7_running;
+	uint8_t uart_tx_pending;
+	uint8_t* uart_rx_buffer;
+	uint32_t uart_rx_size;
+	uint32_t uart_rx_index;
+	uint8_t uart_rx_pending;
+
+	/* Last page of the flash, erased by hal_reset() */
+	uint64_t flash_page[FLASH_PAGE_SIZE / sizeof(uint64_t)];
+	uint8_t flash_locked;
+
+	/* Virtual clock in us */
+	uint64_t now;
+	uint64_t next_scan;
+	uint64_t next_control;
+
+	/* Values of the next ADC scans in the order of the ranks, used if no sampler is set */
+	uint16_t adc_input[HAL_ADC_SCAN_LENGTH];
+
+	/* Optional source of the ADC scans, called with the virtual time of every scan */
+	void (*adc_sampler)(void* user, uint64_t micros, uint16_t* scan);
+
+	/* Optional sink of the bytes sent over USART2 */
+	void (*uart_sink)(void* user, const uint8_t* data, uint32_t len);
+
+	/* Passed to the sampler and the sink */
+	void* user;
+};
+
+void hal_reset(HalInstance* hal);
+void hal_select(HalInstance* hal);
+uint64_t hal_micros();
+void hal_advance(uint64_t micros);
+float hal_pwmDuty(uint32_t channel);
+void hal_uartReceive(const uint8_t* data, uint32_t len);
+
+#endif /* __STM32L4XX_HAL_H */
@@ -0,0 +1,186 @@
+/**
+ * @brief  Batch evaluation of many robots in one process.
+ *
+ * Every lap is a Sim with its own microcontroller and RobotContext. The laps are spread over
+ * threads, each thread steps its laps round-robin one behaviour period at a time, so all of
+ * them are in flight at once. Afterwards a few laps are simulated again on their own with
+ * sim_run(); as the instances share no mutable state, the outcomes must be identical.
+ *
+ * Usage: batch [-n laps] [-j threads] [-c checked laps]
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sim.h"
+
+typedef struct
+{
+	Sim* sims;
+	int first;
+	int stride;
+	int count;
+} Worker;
+
+static Track track;
+static TrackPose start;
+static Obstacle obstacle;
+
+/**
+ * @brief  Current time in seconds.
+ */
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief  Variation of the course of one lap, derived from its number only.
+ */
+static void makeConfig(SimConfig* config, int lap)
+{
+	sim_defaultConfig(config, &track);
+	config->start = start;
+	config->obstacle = obstacle;
+	config->seed = lap + 1;
+	config->adc_noise = 10 * (lap % 8);
+	config->motor_left = 1 + 0.01f * (lap % 5 - 2);
+	config->motor_right = 1 - 0.01f * (lap % 3 - 1);
+}
+
+/**
+ * @brief  Steps the laps of one thread round-robin until all of them are over.
+ */
+static void* runWorker(void* argument)
+{
+	Worker* worker = argument;
+	int running = 1;
+	while (running)
+	{
+		running = 0;
+		for (int i = worker->first; i < worker->count; i += worker->stride)
+		{
+			running |= sim_step(&worker->sims[i]);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief  Compares the outcomes of the same lap.
+ */
+static int sameResult(const SimResult* a, const SimResult* b)
+{
+	return a->finished == b->finished && a->lap_time == b->lap_time && a->line_losses == b->line_losses
+		&& a->collisions == b->collisions && a->state == b->state && a->pose.x == b->pose.x
+		&& a->pose.y == b->pose.y && a->pose.theta == b->pose.theta && a->odometry.x == b->odometry.x
+		&& a->odometry.y == b->odometry.y && a->odometry.theta == b->odometry.theta;
+}
+
+int main(int argc, char** argv)
+{
+	int count = 1000;
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int checked = 8;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:j:c:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': count = atoi(optarg); break;
+			case 'j': threads = atoi(optarg); break;
+			case 'c': checked = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n laps] [-j threads] [-c checked laps]\n", argv[0]);
+				return 2;
+		}
+	}
+	if (count < 1 || threads < 1)
+	{
+		fprintf(stderr, "at least one lap and one thread\n");
+		return 2;
+	}
+	if (checked > count)
+	{
+		checked = count;
+	}
+
+	track_generateParkour(&track, &start, &obstacle);
+
+	SimConfig* configs = calloc(count, sizeof(SimConfig));
+	Sim* sims = calloc(count, sizeof(Sim));
+	Worker* workers = calloc(threads, sizeof(Worker));
+	pthread_t* ids = calloc(threads, sizeof(pthread_t));
+	if (configs == NULL || sims == NULL || workers == NULL || ids == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 2;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		makeConfig(&configs[i], i);
+		sim_start(&sims[i], &configs[i]);
+	}
+
+	double begin = now();
+	for (int t = 0; t < threads; t++)
+	{
+		workers[t] = (Worker) {.sims = sims, .first = t, .stride = threads, .count = count};
+		pthread_create(&ids[t], NULL, runWorker, &workers[t]);
+	}
+	for (int t = 0; t < threads; t++)
+	{
+		pthread_join(ids[t], NULL);
+	}
+	double seconds = now() - begin;
+
+	int finished = 0;
+	double simulated = 0;
+	double lap_time = 0;
+	for (int i = 0; i < count; i++)
+	{
+		SimResult result;
+		sim_result(&sims[i], &result);
+		simulated += result.lap_time;
+		if (result.finished)
+		{
+			lap_time += result.lap_time;
+			finished++;
+		}
+	}
+
+	printf("laps          %d on %d threads, %zu bytes each\n", count, threads, sizeof(Sim));
+	printf("finished      %d (mean lap time %.2f s)\n", finished, finished > 0 ? lap_time / finished : 0);
+	printf("wall time     %.3f s (%.1f laps/s, %.0fx real time)\n", seconds, count / seconds, simulated / seconds);
+
+	int mismatches = 0;
+	for (int i = 0; i < checked; i++)
+	{
+		SimResult alone;
+		SimResult batched;
+		sim_run(&configs[i], &alone);
+		sim_result(&sims[i], &batched);
+		if (!sameResult(&alone, &batched))
+		{
+			printf("lap %d differs: %.3f s alone, %.3f s in the batch\n", i, alone.lap_time, batched.lap_time);
+			mismatches++;
+		}
+	}
+	printf("checked       %d laps against single runs, %d differ\n", checked, mismatches);
+
+	free(ids);
+	free(workers);
+	free(sims);
+	free(configs);
+	track_free(&track);
+	return mismatches != 0;
+}
@@ -0,0 +1,410 @@
+/**
+ * @brief  Decoder of the telemetry stream of the robot.
+ *
+ * Reads the frames the robot sent over USART2 (from a file, the serial port or the -u output of
+ * simulate), checks them and decodes them with the protocol of the firmware. The sample frames
+ * can be written as CSV or as columns, the text frames carry the statistics lines of the latency
+ * tracing and the profiler. The latest statistics of every histogram are printed as a table
+ * with percentiles estimated from the log2 buckets (upper bound of the bucket).
+ *
+ * Usage: decode [-f] [-o samples.csv] [-c directory] [-r records.csv] [telemetry.bin]
+ *
+ * -f prints every statistics line as soon as it is decoded, e.g. while reading the serial port.
+ * -o writes one CSV line per sample.
+ * -c writes one file <column>.i32 per column into an existing directory, every sample appends
+ *    a little-endian int32, e.g. for numpy.fromfile(path, "<i4").
+ * -r writes the records of a dump of the flight recorder as CSV, with the position relative to
+ *    the trigger (negative before it), the trigger and the sub-state before the sample columns.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+#define MAX_HISTOGRAMS 32
+#define MAX_BUCKETS    32
+
+/* Latest statistics of one histogram */
+typedef struct
+{
+	char group[32];
+	char name[64];
+	unsigned count;
+	unsigned min;
+	unsigned mean;
+	unsigned max;
+	unsigned buckets[MAX_BUCKETS];
+} Histogram;
+
+static Histogram histograms[MAX_HISTOGRAMS];
+static int histogram_count = 0;
+
+/* Columns of the sample output */
+enum
+{
+	COL_TIMESTAMP,
+	COL_ADC0, COL_ADC1, COL_ADC2, COL_ADC3, COL_ADC4, COL_ADC5,
+	COL_ENCODER_LEFT, COL_ENCODER_RIGHT,
+	COL_STATE,
+	COL_PWM_LEFT, COL_PWM_RIGHT,
+	COLUMNS
+};
+
+static const char* const column_names[COLUMNS] =
+{
+	"timestamp", "adc0", "adc1", "adc2", "adc3", "adc4", "adc5",
+	"encoder_left", "encoder_right", "state", "pwm_left", "pwm_right",
+};
+
+/* Counters of the received frames */
+typedef struct
+{
+	uint64_t bytes;
+	unsigned frames;
+	unsigned samples;
+	unsigned key_frames;
+	unsigned texts;
+	unsigned records;
+	unsigned lost;
+	unsigned crc_errors;
+	unsigned framing_errors;
+	unsigned version_errors;
+	unsigned skipped;         /* Sample frames that could not be decoded for want of a key frame */
+} Counters;
+
+/**
+ * @brief  Value below which a share of the samples lies, estimated from the buckets.
+ */
+static unsigned percentile(const Histogram* histogram, double share)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < MAX_BUCKETS; i++)
+	{
+		total += histogram->buckets[i];
+	}
+
+	uint64_t sum = 0;
+	for (int i = 0; i < MAX_BUCKETS; i++)
+	{
+		sum += histogram->buckets[i];
+		if (total != 0 && sum >= share * total)
+		{
+			unsigned upper = i < 31 ? (2u << i) - 1 : UINT32_MAX;
+			return upper < histogram->max ? upper : histogram->max;
+		}
+	}
+	return histogram->max;
+}
+
+static void printHeader()
+{
+	printf("%-8s %-18s %10s %10s %10s %10s %10s %10s %10s\n", "group", "name", "n", "min", "mean", "max", "p50", "p90", "p99");
+}
+
+static void printHistogram(const Histogram* histogram)
+{
+	printf("%-8s %-18s %10u %10u %10u %10u %10u %10u %10u\n", histogram->group, histogram->name, histogram->count, histogram->min,
+			histogram->mean, histogram->max, percentile(histogram, 0.5), percentile(histogram, 0.9), percentile(histogram, 0.99));
+}
+
+/**
+ * @brief  Decodes a statistics line "# <group> <name>: n .., min .., mean .., max .., log2 b:c ...".
+ *
+ * @return the updated histogram, NULL if the line is not a statistics line
+ */
+static Histogram* decodeStatistics(const char* line)
+{
+	Histogram decoded = {0};
+	int offset = 0;
+	if (sscanf(line, "# %31s %63[^:]: n %u, min %u, mean %u, max %u, log2%n", decoded.group, decoded.name,
+			&decoded.count, &decoded.min, &decoded.mean, &decoded.max, &offset) != 6 || offset == 0)
+	{
+		return NULL;
+	}
+
+	int bucket;
+	unsigned count;
+	int consumed;
+	const char* rest = line + offset;
+	while (sscanf(rest, " %d:%u%n", &bucket, &count, &consumed) == 2)
+	{
+		if (bucket >= 0 && bucket < MAX_BUCKETS)
+		{
+			decoded.buckets[bucket] = count;
+		}
+		rest += consumed;
+	}
+
+	for (int i = 0; i < histogram_count; i++)
+	{
+		if (strcmp(histograms[i].group, decoded.group) == 0 && strcmp(histograms[i].name, decoded.name) == 0)
+		{
+			histograms[i] = decoded;
+			return &histograms[i];
+		}
+	}
+	if (histogram_count == MAX_HISTOGRAMS)
+	{
+		return NULL;
+	}
+	histograms[histogram_count] = decoded;
+	return &histograms[histogram_count++];
+}
+
+/**
+ * @brief  Handles a statistics line or passes another text through.
+ */
+static void decodeText(const char* text, int follow)
+{
+	Histogram* histogram = decodeStatistics(text);
+	if (histogram == NULL)
+	{
+		/* Other lines, e.g. the clock of the profiler, are passed through */
+		fputs(text, stdout);
+	}
+	else if (follow)
+	{
+		printHistogram(histogram);
+		fflush(stdout);
+	}
+}
+
+static void sampleColumns(const ProtocolSample* sample, int32_t* values)
+{
+	values[COL_TIMESTAMP] = (int32_t) sample->timestamp;
+	for (int i = 0; i < PROTOCOL_ADC_CHANNELS; i++)
+	{
+		values[COL_ADC0 + i] = sample->adc[i];
+	}
+	values[COL_ENCODER_LEFT] = sample->encoder_left;
+	values[COL_ENCODER_RIGHT] = sample->encoder_right;
+	values[COL_STATE] = sample->state;
+	values[COL_PWM_LEFT] = sample->pwm_left;
+	values[COL_PWM_RIGHT] = sample->pwm_right;
+}
+
+static void writeCsv(FILE* csv, const int32_t* values)
+{
+	/* The timestamp wraps around after 71 minutes and is printed unsigned */
+	fprintf(csv, "%u", (unsigned) values[COL_TIMESTAMP]);
+	for (int i = 1; i < COLUMNS; i++)
+	{
+		fprintf(csv, ",%d", values[i]);
+	}
+	fputc('\n', csv);
+}
+
+static void writeColumns(FILE** columns, const int32_t* values)
+{
+	for (int i = 0; i < COLUMNS; i++)
+	{
+		uint32_t value = (uint32_t) values[i];
+		uint8_t bytes[4] = {(uint8_t) value, (uint8_t) (value >> 8), (uint8_t) (value >> 16), (uint8_t) (value >> 24)};
+		fwrite(bytes, 1, sizeof(bytes), columns[i]);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int follow = 0;
+	const char* csv_path = NULL;
+	const char* column_dir = NULL;
+	const char* record_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "fo:c:r:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f': follow = 1; break;
+			case 'o': csv_path = optarg; break;
+			case 'c': column_dir = optarg; break;
+			case 'r': record_path = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-f] [-o samples.csv] [-c directory] [-r records.csv] [telemetry.bin]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	FILE* input = stdin;
+	if (optind < argc && (input = fopen(argv[optind], "rb")) == NULL)
+	{
+		fprintf(stderr, "cannot read %s\n", argv[optind]);
+		return 2;
+	}
+
+	FILE* csv = NULL;
+	if (csv_path != NULL)
+	{
+		if ((csv = fopen(csv_path, "w")) == NULL)
+		{
+			fprintf(stderr, "cannot write %s\n", csv_path);
+			return 2;
+		}
+		for (int i = 0; i < COLUMNS; i++)
+		{
+			fprintf(csv, i == 0 ? "%s" : ",%s", column_names[i]);
+		}
+		fputc('\n', csv);
+	}
+
+	FILE* records = NULL;
+	if (record_path != NULL)
+	{
+		if ((records = fopen(record_path, "w")) == NULL)
+		{
+			fprintf(stderr, "cannot write %s\n", record_path);
+			return 2;
+		}
+		fprintf(records, "position,trigger,sub_state");
+		for (int i = 0; i < COLUMNS; i++)
+		{
+			fprintf(records, ",%s", column_names[i]);
+		}
+		fputc('\n', records);
+	}
+
+	FILE* columns[COLUMNS] = {NULL};
+	if (column_dir != NULL)
+	{
+		for (int i = 0; i < COLUMNS; i++)
+		{
+			char path[512];
+			snprintf(path, sizeof(path), "%s/%s.i32", column_dir, column_names[i]);
+			if ((columns[i] = fopen(path, "wb")) == NULL)
+			{
+				fprintf(stderr, "cannot write %s\n", path);
+				return 2;
+			}
+		}
+	}
+
+	ProtocolStream stream;
+	protocol_init(&stream, 0);
+	static ProtocolMessage message;
+	Counters counters = {0};
+	uint8_t frame[PROTOCOL_MAX_FRAME];
+	uint32_t frame_len = 0;
+	int overflow = 0;
+	int c;
+
+	if (follow)
+	{
+		printHeader();
+	}
+	while ((c = fgetc(input)) != EOF)
+	{
+		counters.bytes++;
+		if (c != 0)
+		{
+			/* A frame without delimiter that is too long is dropped up to the next delimiter */
+			if (frame_len < sizeof(frame))
+			{
+				frame[frame_len++] = (uint8_t) c;
+			}
+			else
+			{
+				overflow = 1;
+			}
+			continue;
+		}
+
+		uint32_t len = frame_len;
+		frame_len = 0;
+		if (overflow)
+		{
+			overflow = 0;
+			counters.framing_errors++;
+			continue;
+		}
+		if (len == 0)
+		{
+			continue;
+		}
+
+		counters.frames++;
+		int32_t type = protocol_decode(&stream, frame, len, &message);
+		if (type > 0)
+		{
+			counters.lost += message.lost;
+		}
+		switch (type)
+		{
+			case PROTOCOL_SAMPLE:
+			{
+				counters.samples++;
+				counters.key_frames += message.key;
+				int32_t values[COLUMNS];
+				sampleColumns(&message.sample, values);
+				if (csv != NULL)
+				{
+					writeCsv(csv, values);
+				}
+				if (column_dir != NULL)
+				{
+					writeColumns(columns, values);
+				}
+				break;
+			}
+			case PROTOCOL_TEXT:
+				counters.texts++;
+				decodeText(message.text, follow);
+				break;
+			case PROTOCOL_RECORD:
+				counters.records++;
+				if (records != NULL)
+				{
+					int32_t values[COLUMNS];
+					sampleColumns(&message.record.sample, values);
+					fprintf(records, "%d,%u,%u,", message.record.position, message.record.trigger, message.record.sub_state);
+					writeCsv(records, values);
+				}
+				break;
+			case PROTOCOL_ERROR_CRC: counters.crc_errors++; break;
+			case PROTOCOL_ERROR_VERSION: counters.version_errors++; break;
+			case PROTOCOL_ERROR_NO_KEY: counters.skipped++; break;
+			default: counters.framing_errors++; break;
+		}
+	}
+
+	printf("%llu bytes, %u frames: %u samples (%u key frames), %u texts, %u records\n", (unsigned long long) counters.bytes,
+			counters.frames, counters.samples, counters.key_frames, counters.texts, counters.records);
+	printf("%u lost, %u CRC errors, %u framing errors, %u version errors, %u samples without key frame\n", counters.lost,
+			counters.crc_errors, counters.framing_errors, counters.version_errors, counters.skipped);
+	printf("%d histograms\n", histogram_count);
+	if (histogram_count > 0)
+	{
+		printHeader();
+		for (int i = 0; i < histogram_count; i++)
+		{
+			printHistogram(&histograms[i]);
+		}
+	}
+
+	if (csv != NULL)
+	{
+		fclose(csv);
+	}
+	if (records != NULL)
+	{
+		fclose(records);
+	}
+	for (int i = 0; i < COLUMNS; i++)
+	{
+		if (columns[i] != NULL)
+		{
+			fclose(columns[i]);
+		}
+	}
+	if (input != stdin)
+	{
+		fclose(input);
+	}
+	return 0;
+}
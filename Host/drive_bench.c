@@ -0,0 +1,187 @@
+/**
+ * @brief  Host benchmark of the motor control math: the former double version of drive()
+ * 		   and of a control step against the Q16.16 fixed-point version.
+ *
+ * Only the arithmetic is measured, the register writes are replaced by stores into
+ * variables. On the host double is done in hardware, so the gap is far smaller than on the
+ * Cortex-M4F, where every double operation is a call into a software routine.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "fixedpoint.h"
+
+#define ITERATIONS 10000000
+#define MAX_PWM    65535
+
+volatile uint32_t ccr2;
+volatile uint32_t ccr3;
+volatile int phase_left;
+volatile int phase_right;
+
+/**
+ * @brief  drive() as it was implemented with double.
+ */
+static void drive_double(double speed_left, double speed_right)
+{
+	if (speed_left > 0)
+	{
+		ccr2 = (int) (MAX_PWM * speed_left);
+		phase_left = 0;
+	}
+	else if (speed_left < 0)
+	{
+		ccr2 = (uint16_t) (int) (MAX_PWM - MAX_PWM * speed_left);
+		phase_left = 1;
+	}
+	else
+	{
+		ccr2 = 0;
+		phase_left = 0;
+	}
+
+	if (speed_right > 0)
+	{
+		ccr3 = (int) (MAX_PWM * speed_right);
+		phase_right = 0;
+	}
+	else if (speed_right < 0)
+	{
+		ccr3 = (uint16_t) (int) (MAX_PWM - MAX_PWM * speed_right);
+		phase_right = 1;
+	}
+	else
+	{
+		ccr3 = 0;
+		phase_right = 0;
+	}
+}
+
+/**
+ * @brief  drive() as it is implemented with Q16.16.
+ */
+static void drive_fixed(q16_t speed_left, q16_t speed_right)
+{
+	speed_left = q16_saturate(speed_left, -Q16_ONE, Q16_ONE);
+	speed_right = q16_saturate(speed_right, -Q16_ONE, Q16_ONE);
+
+	ccr2 = q16_scale(speed_left < 0 ? -speed_left : speed_left, MAX_PWM);
+	phase_left = speed_left < 0;
+	ccr3 = q16_scale(speed_right < 0 ? -speed_right : speed_right, MAX_PWM);
+	phase_right = speed_right < 0;
+}
+
+/**
+ * @brief  One control step (driveForward() and the P-controller of task_followLine()) with double.
+ */
+static void step_double(int32_t ticks, int32_t line_error, double speed)
+{
+	float encoder_gain = 0.15f;
+	double delta_left = ticks * encoder_gain * speed;
+	double delta_right = ticks * encoder_gain * speed;
+	drive_double(speed - delta_left, speed + delta_right);
+
+	float line_gain = 0.00015f;
+	drive_double(speed - line_error * line_gain, speed + line_error * line_gain);
+}
+
+/**
+ * @brief  One control step (driveForward() and the P-controller of task_followLine()) with Q16.16.
+ */
+static void step_fixed(int32_t ticks, int32_t line_error, q16_t speed)
+{
+	q16_t correction = q16_mulInt(Q16(0.15), ticks);
+	q16_t delta_left = q16_mul(correction, speed);
+	q16_t delta_right = q16_mul(correction, speed);
+	drive_fixed(q16_sub(speed, delta_left), q16_add(speed, delta_right));
+
+	q16_t line_correction = q16_mulInt(Q16(0.00015), line_error);
+	drive_fixed(q16_sub(speed, line_correction), q16_add(speed, line_correction));
+}
+
+/**
+ * @brief  Current time in nanoseconds.
+ */
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief  Prints the time per iteration of a measurement.
+ */
+static void report(const char* name, double start_ns, uint64_t start_cycles)
+{
+	uint64_t cycles = __rdtsc() - start_cycles;
+	double ns = now() - start_ns;
+	printf("%-20s %8.2f ns %8.2f cycles\n", name, ns / ITERATIONS, (double) cycles / ITERATIONS);
+}
+
+int main()
+{
+	/* Inputs vary with the loop counter so that nothing can be hoisted out of the loop */
+	static const double speeds[4] = {0.5, -0.5, 0.3, -0.75};
+	static const q16_t fixed_speeds[4] = {Q16(0.5), Q16(-0.5), Q16(0.3), Q16(-0.75)};
+	double start;
+	uint64_t cycles;
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		drive_double(speeds[i & 3], speeds[(i + 1) & 3]);
+	}
+	report("drive (double)", start, cycles);
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		drive_fixed(fixed_speeds[i & 3], fixed_speeds[(i + 1) & 3]);
+	}
+	report("drive (q16)", start, cycles);
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		step_double((i & 15) - 8, (i & 1023) - 512, speeds[i & 3]);
+	}
+	report("step (double)", start, cycles);
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		step_fixed((i & 15) - 8, (i & 1023) - 512, fixed_speeds[i & 3]);
+	}
+	report("step (q16)", start, cycles);
+
+	/*
+	 * Both versions must command the same PWM values. The old reverse branch only worked
+	 * because the 16 bit CCR truncated MAX_PWM - MAX_PWM * speed, so together with the
+	 * rounding of the Q16.16 speed the results may differ by two steps.
+	 */
+	int mismatches = 0;
+	for (int s = -100; s <= 100; s++)
+	{
+		drive_double(s / 100.0, s / 100.0);
+		uint32_t expected = ccr2;
+		drive_fixed(Q16(s / 100.0), Q16(s / 100.0));
+		int32_t difference = (int32_t) ccr2 - (int32_t) expected;
+		if (difference > 2 || difference < -2)
+		{
+			printf("speed %+.2f: double %u, q16 %u\n", s / 100.0, expected, ccr2);
+			mismatches++;
+		}
+	}
+
+	return mismatches != 0;
+}
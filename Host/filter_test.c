@@ -0,0 +1,167 @@
+/**
+ * @brief  Host-side test of the ADC filters.
+ *
+ * Feeds every filter configuration with a noisy constant and with a step, then compares the
+ * measured noise variance and group delay with the values expected from theory.
+ *
+ * @author Lukas Probst
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "filter.h"
+
+#define SETTLE_SAMPLES 1000
+#define NOISE_SAMPLES  200000
+#define STEP_SAMPLES   2000
+
+#define SIGNAL_LEVEL 2000
+#define NOISE_SIGMA  40.0
+#define STEP_LOW     500
+#define STEP_HIGH    3500
+
+/**
+ * @brief  Normally distributed random number (Box-Muller).
+ *
+ * @return sample with mean 0 and variance 1
+ */
+static double gaussian()
+{
+	double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/**
+ * @brief  Clamps a value to the 12 bit range of the ADC.
+ *
+ * @param  value value to clamp
+ * @return clamped value
+ */
+static uint16_t clampSample(double value)
+{
+	if (value < 0)
+	{
+		return 0;
+	}
+	if (value > 4095)
+	{
+		return 4095;
+	}
+	return (uint16_t) lround(value);
+}
+
+/**
+ * @brief  Measures the variance of the filter output for a noisy constant input.
+ *
+ * @param  type kind of filter
+ * @param  shift smoothing of the filter
+ * @param  input_variance receives the variance of the input
+ * @return variance of the output
+ */
+static double measureVariance(FilterType type, uint8_t shift, double* input_variance)
+{
+	Filter filter;
+	filter_init(&filter, type, shift, SIGNAL_LEVEL);
+	srand(1);
+
+	double in_sum = 0, in_sq = 0, out_sum = 0, out_sq = 0;
+	for (int n = 0; n < SETTLE_SAMPLES + NOISE_SAMPLES; n++)
+	{
+		uint16_t x = clampSample(SIGNAL_LEVEL + NOISE_SIGMA * gaussian());
+		uint16_t y = filter_update(&filter, x);
+		if (n >= SETTLE_SAMPLES)
+		{
+			in_sum += x;
+			in_sq += (double) x * x;
+			out_sum += y;
+			out_sq += (double) y * y;
+		}
+	}
+
+	double in_mean = in_sum / NOISE_SAMPLES;
+	double out_mean = out_sum / NOISE_SAMPLES;
+	*input_variance = in_sq / NOISE_SAMPLES - in_mean * in_mean;
+	return out_sq / NOISE_SAMPLES - out_mean * out_mean;
+}
+
+/**
+ * @brief  Measures the group delay at low frequencies from the step response.
+ *
+ * For a filter with unit DC gain the sum of (1 - s[n]) over the normalised step response
+ * equals the centroid of the impulse response, i.e. the group delay in samples.
+ *
+ * @param  type kind of filter
+ * @param  shift smoothing of the filter
+ * @return group delay in samples
+ */
+static double measureGroupDelay(FilterType type, uint8_t shift)
+{
+	Filter filter;
+	filter_init(&filter, type, shift, STEP_LOW);
+
+	double delay = 0;
+	for (int n = 0; n < STEP_SAMPLES; n++)
+	{
+		uint16_t y = filter_update(&filter, STEP_HIGH);
+		delay += 1.0 - (double) (y - STEP_LOW) / (STEP_HIGH - STEP_LOW);
+	}
+	return delay;
+}
+
+int main()
+{
+	static const struct
+	{
+		FilterType type;
+		uint8_t shift;
+	} configs[] =
+	{
+		{FILTER_NONE, 0},
+		{FILTER_IIR, 1}, {FILTER_IIR, 2}, {FILTER_IIR, 3}, {FILTER_IIR, 4}, {FILTER_IIR, 6},
+		{FILTER_MOVING_AVERAGE, 1}, {FILTER_MOVING_AVERAGE, 2}, {FILTER_MOVING_AVERAGE, 3}, {FILTER_MOVING_AVERAGE, 4},
+	};
+	static const char* names[] = {"none", "iir", "average"};
+	int failures = 0;
+
+	printf("%-8s %5s %12s %12s %10s %10s %10s\n", "filter", "shift", "var in", "var out", "expected", "delay", "expected");
+	for (unsigned i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+	{
+		FilterType type = configs[i].type;
+		uint8_t shift = configs[i].shift;
+
+		double expected_ratio, expected_delay;
+		if (type == FILTER_IIR)
+		{
+			double alpha = 1.0 / (1 << shift);
+			expected_ratio = alpha / (2.0 - alpha);
+			expected_delay = (1.0 - alpha) / alpha;
+		}
+		else if (type == FILTER_MOVING_AVERAGE)
+		{
+			expected_ratio = 1.0 / (1 << shift);
+			expected_delay = ((1 << shift) - 1) / 2.0;
+		}
+		else
+		{
+			expected_ratio = 1.0;
+			expected_delay = 0.0;
+		}
+
+		double input_variance;
+		double output_variance = measureVariance(type, shift, &input_variance);
+		double delay = measureGroupDelay(type, shift);
+
+		/* Rounding to integers adds about 1/12 LSB^2 of noise on top of the theory */
+		int ok = output_variance <= input_variance * expected_ratio * 1.1 + 1.0 / 12 + 0.05
+				&& fabs(delay - expected_delay) <= 0.5;
+		failures += !ok;
+
+		printf("%-8s %5u %12.2f %12.2f %10.2f %10.2f %10.2f %s\n", names[type], shift, input_variance,
+				output_variance, input_variance * expected_ratio, delay, expected_delay, ok ? "" : "FAILED");
+	}
+
+	return failures != 0;
+}
@@ -0,0 +1,232 @@
+/**
+ * @brief  Host benchmark of the integer formatter against snprintf().
+ *
+ * Formats a statistics line of the latency tracing and single numbers with both, and checks
+ * that fmt.c produces the same text as the printf family for random values, including the
+ * decimal fractions of the command interface. On the host
+ * glibc is highly tuned, on the Cortex-M4 newlib-nano parses the format string and goes
+ * through its stream machinery for every call, so the gap is larger there.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "fmt.h"
+
+#define ITERATIONS 2000000
+#define CHECKS     1000000
+
+static const uint32_t buckets[8] = {0, 0, 3, 17, 250, 2400, 12, 1};
+
+/**
+ * @brief  Current time in nanoseconds.
+ */
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief  Prints the time per iteration of a measurement.
+ */
+static void report(const char* name, double start_ns, uint64_t start_cycles)
+{
+	uint64_t cycles = __rdtsc() - start_cycles;
+	double ns = now() - start_ns;
+	printf("%-20s %8.2f ns %8.2f cycles\n", name, ns / ITERATIONS, (double) cycles / ITERATIONS);
+}
+
+/**
+ * @brief  Statistics line as latency_report() formatted it with snprintf().
+ */
+static uint32_t lineSnprintf(char* string_buf, uint32_t size, uint32_t count)
+{
+	uint32_t len = snprintf(string_buf, size, "# latency %s: n %u, min %u, mean %u, max %u, log2", "sensor_to_pwm",
+			count, 5200u, 5400u, 5600u);
+	for (int i = 0; i < 8 && len < size; i++)
+	{
+		if (buckets[i] != 0)
+		{
+			len += snprintf(string_buf + len, size - len, " %d:%u", i, buckets[i]);
+		}
+	}
+	return len;
+}
+
+/**
+ * @brief  Statistics line as latency_report() formats it with fmt.c.
+ */
+static uint32_t lineFmt(char* string_buf, uint32_t size, uint32_t count)
+{
+	FmtBuffer out;
+	fmt_init(&out, string_buf, size);
+	fmt_string(&out, "# latency ");
+	fmt_string(&out, "sensor_to_pwm");
+	fmt_string(&out, ": n ");
+	fmt_unsigned(&out, count, 0);
+	fmt_string(&out, ", min ");
+	fmt_unsigned(&out, 5200, 0);
+	fmt_string(&out, ", mean ");
+	fmt_unsigned(&out, 5400, 0);
+	fmt_string(&out, ", max ");
+	fmt_unsigned(&out, 5600, 0);
+	fmt_string(&out, ", log2");
+	for (int i = 0; i < 8; i++)
+	{
+		if (buckets[i] != 0)
+		{
+			fmt_char(&out, ' ');
+			fmt_unsigned(&out, i, 0);
+			fmt_char(&out, ':');
+			fmt_unsigned(&out, buckets[i], 0);
+		}
+	}
+	return out.len;
+}
+
+/**
+ * @brief  Random value with a random number of significant bits.
+ */
+static uint32_t randomValue()
+{
+	uint32_t value = ((uint32_t) rand() << 16) ^ (uint32_t) rand() ^ ((uint32_t) rand() << 31);
+	return value >> (rand() % 32);
+}
+
+/**
+ * @brief  Compares the writers with snprintf() for random values and widths.
+ *
+ * @return number of mismatches
+ */
+static int check()
+{
+	static const uint32_t edges[] = {0, 1, 9, 10, 99, 100, 4095, 65535, 999999999, 1000000000, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF};
+	char expected[32];
+	char actual[32];
+	FmtBuffer out;
+	int mismatches = 0;
+
+	for (int i = 0; i < CHECKS; i++)
+	{
+		uint32_t value = i < (int) (sizeof(edges) / sizeof(edges[0])) ? edges[i] : randomValue();
+		uint8_t width = rand() % 13;
+		uint8_t digits = 1 + rand() % 8;
+
+		for (int kind = 0; kind < 4; kind++)
+		{
+			fmt_init(&out, actual, sizeof(actual));
+			if (kind == 0)
+			{
+				snprintf(expected, sizeof(expected), "%*u", width, value);
+				fmt_unsigned(&out, value, width);
+			}
+			else if (kind == 1)
+			{
+				snprintf(expected, sizeof(expected), "%*d", width, (int32_t) value);
+				fmt_signed(&out, (int32_t) value, width);
+			}
+			else if (kind == 2)
+			{
+				snprintf(expected, sizeof(expected), "%0*x", digits, value & (uint32_t) (0xFFFFFFFFull >> (32 - 4 * digits)));
+				fmt_hex(&out, value, digits);
+			}
+			else
+			{
+				/* Decimal fraction with up to 8 places */
+				int64_t signed_value = (int32_t) value;
+				uint64_t magnitude = signed_value < 0 ? -signed_value : signed_value;
+				uint64_t scale = 1;
+				for (int d = 0; d < digits; d++)
+				{
+					scale *= 10;
+				}
+				snprintf(expected, sizeof(expected), "%s%llu.%0*llu", signed_value < 0 ? "-" : "", (unsigned long long) (magnitude / scale),
+						digits % 9, (unsigned long long) (magnitude % scale));
+				fmt_fixed(&out, (int32_t) value, digits);
+			}
+
+			if (out.len != strlen(expected) || memcmp(actual, expected, out.len) != 0)
+			{
+				if (mismatches++ < 10)
+				{
+					printf("kind %d, value %u: expected \"%s\", got \"%.*s\"\n", kind, value, expected, (int) out.len, actual);
+				}
+			}
+		}
+	}
+
+	/* Text that does not fit is cut at the end of the buffer */
+	fmt_init(&out, actual, 4);
+	fmt_string(&out, "n ");
+	fmt_unsigned(&out, 12345, 0);
+	if (out.len != 4 || memcmp(actual, "n 12", 4) != 0)
+	{
+		printf("cut: got \"%.*s\"\n", (int) out.len, actual);
+		mismatches++;
+	}
+
+	return mismatches;
+}
+
+int main()
+{
+	char expected[200];
+	char actual[200];
+	volatile uint32_t sink = 0;
+	double start;
+	uint64_t cycles;
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		sink += lineSnprintf(expected, sizeof(expected), i);
+	}
+	report("line (snprintf)", start, cycles);
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		sink += lineFmt(actual, sizeof(actual), i);
+	}
+	report("line (fmt)", start, cycles);
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		sink += snprintf(expected, sizeof(expected), "%u", (uint32_t) i * 2654435761u);
+	}
+	report("number (snprintf)", start, cycles);
+
+	start = now();
+	cycles = __rdtsc();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		FmtBuffer out;
+		fmt_init(&out, actual, sizeof(actual));
+		fmt_unsigned(&out, (uint32_t) i * 2654435761u, 0);
+		sink += out.len;
+	}
+	report("number (fmt)", start, cycles);
+
+	int mismatches = check();
+	uint32_t len = lineFmt(actual, sizeof(actual), 2700);
+	if (len != lineSnprintf(expected, sizeof(expected), 2700) || memcmp(actual, expected, len) != 0)
+	{
+		printf("line: expected \"%s\", got \"%.*s\"\n", expected, (int) len, actual);
+		mismatches++;
+	}
+	printf("%d mismatches against snprintf\n", mismatches);
+
+	return mismatches != 0;
+}
@@ -0,0 +1,369 @@
+/**
+ * @brief  Host stand-in for the HAL functions and peripherals used by the firmware.
+ *
+ * Time only passes in hal_advance(). On the way it triggers the same interrupts the
+ * hardware would: an ADC scan at ADC_SAMPLE_RATE_HZ with the DMA half and complete
+ * callbacks, the TIM7 period interrupt at VELOCITY_CONTROL_RATE_HZ, the completion of a
+ * UART transfer and the idle line after bytes were received. Callbacks run to completion, so nothing preempts the code under test.
+ *
+ * All state lives in the HalInstance selected by hal_reset() or hal_select() in the calling
+ * thread.
+ *
+ * @author Lukas Probst
+ */
+
+#include <string.h>
+
+#include "main.h"
+#include "adc.h"
+#include "tim.h"
+#include "usart.h"
+#include "velocity.h"
+
+#define ADC_SCAN_PERIOD_US    (1000000 / ADC_SAMPLE_RATE_HZ)
+#define CONTROL_PERIOD_US     (1000000 / VELOCITY_CONTROL_RATE_HZ)
+
+__thread HalInstance* hal_current = NULL;
+
+/* Handles that the CubeMX files define on the target */
+ADC_HandleTypeDef hadc1;
+TIM_HandleTypeDef htim1;
+TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim6;
+TIM_HandleTypeDef htim7;
+UART_HandleTypeDef huart2;
+
+/**
+ * @brief  Puts all peripherals and the virtual clock of an instance back into their reset
+ * 		   state and selects it for the calling thread.
+ *
+ * The GPIO inputs start high, as the switches are pulled up and read low when pressed. The
+ * flash starts erased.
+ *
+ * @param  hal instance to reset
+ * @return None
+ */
+void hal_reset(HalInstance* hal)
+{
+	memset(hal, 0, sizeof(*hal));
+	hal->gpioa.IDR = 0xFFFF;
+	hal->gpiob.IDR = 0xFFFF;
+	hal->tim1.ARR = 65535;
+	memset(hal->flash_page, 0xFF, sizeof(hal->flash_page));
+	hal->flash_locked = 1;
+	hal->next_scan = ADC_SCAN_PERIOD_US;
+	hal->next_control = CONTROL_PERIOD_US;
+	hal_select(hal);
+}
+
+/**
+ * @brief  Selects the instance the calling thread works on.
+ *
+ * @param  hal instance to select
+ * @return None
+ */
+void hal_select(HalInstance* hal)
+{
+	hal_current = hal;
+}
+
+/**
+ * @brief  Returns the virtual time since the reset.
+ *
+ * @return time in us
+ */
+uint64_t hal_micros()
+{
+	return hal_current->now;
+}
+
+/**
+ * @brief  Writes one scan into the DMA buffer and raises the DMA callbacks.
+ *
+ * @param  hal current instance
+ * @return None
+ */
+static void adcScan(HalInstance* hal)
+{
+	if (!hal->tim6_running || hal->adc_buffer == NULL)
+	{
+		return;
+	}
+
+	uint16_t scan[HAL_ADC_SCAN_LENGTH];
+	if (hal->adc_sampler != NULL)
+	{
+		hal->adc_sampler(hal->user, hal->now, scan);
+	}
+	else
+	{
+		memcpy(scan, hal->adc_input, sizeof(scan));
+	}
+
+	for (int i = 0; i < HAL_ADC_SCAN_LENGTH; i++)
+	{
+		hal->adc_buffer[hal->adc_index++] = scan[i];
+	}
+
+	ADC_HandleTypeDef handle = {.Instance = &hal->adc1};
+	if (hal->adc_index == hal->adc_length / 2)
+	{
+		HAL_ADC_ConvHalfCpltCallback(&handle);
+	}
+	else if (hal->adc_index >= hal->adc_length)
+	{
+		hal->adc_index = 0;
+		HAL_ADC_ConvCpltCallback(&handle);
+	}
+}
+
+/**
+ * @brief  Lets the virtual time of the current instance pass and raises the interrupts that
+ * 		   fall into it.
+ *
+ * @param  micros time to advance in us
+ * @return None
+ */
+void hal_advance(uint64_t micros)
+{
+	HalInstance* hal = hal_current;
+	uint64_t end = hal->now + micros;
+	while (1)
+	{
+		/* A finished UART transfer completes at the next event */
+		if (hal->uart_tx_pending)
+		{
+			hal->uart_tx_pending = 0;
+			UART_HandleTypeDef handle = {.Instance = &hal->usart2};
+			HAL_UART_TxCpltCallback(&handle);
+		}
+
+		/* Received bytes are reported when the line goes idle at the next event */
+		if (hal->uart_rx_pending)
+		{
+			hal->uart_rx_pending = 0;
+			UART_HandleTypeDef handle = {.Instance = &hal->usart2};
+			HAL_UARTEx_RxEventCallback(&handle, hal->uart_rx_index);
+		}
+
+		uint64_t next = end;
+		if (hal->next_scan < next)
+		{
+			next = hal->next_scan;
+		}
+		if (hal->next_control < next)
+		{
+			next = hal->next_control;
+		}
+		hal->now = next;
+		hal->tim2.CNT = (uint32_t) hal->now;
+
+		if (hal->now == hal->next_scan)
+		{
+			hal->next_scan += ADC_SCAN_PERIOD_US;
+			adcScan(hal);
+		}
+		if (hal->now == hal->next_control)
+		{
+			hal->next_control += CONTROL_PERIOD_US;
+			if (hal->tim7_running)
+			{
+				TIM_HandleTypeDef handle = {.Instance = &hal->tim7};
+				HAL_TIM_PeriodElapsedCallback(&handle);
+			}
+		}
+		if (hal->now == end)
+		{
+			return;
+		}
+	}
+}
+
+/**
+ * @brief  Duty cycle of a PWM channel of TIM1.
+ *
+ * @param  channel TIM_CHANNEL_2 (left motor) or TIM_CHANNEL_3 (right motor)
+ * @return duty cycle in [0, 1]
+ */
+float hal_pwmDuty(uint32_t channel)
+{
+	TIM_TypeDef* tim = &hal_current->tim1;
+	uint32_t ccr = channel == TIM_CHANNEL_2 ? tim->CCR2 : tim->CCR3;
+	return (float) (ccr & 0xFFFF) / tim->ARR;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t) (hal_current->now / 1000);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state)
+{
+	if (state == GPIO_PIN_SET)
+	{
+		port->ODR |= pin;
+	}
+	else
+	{
+		port->ODR &= ~pin;
+	}
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef* port, uint16_t pin)
+{
+	port->ODR ^= pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* port, uint16_t pin)
+{
+	return (port->IDR & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim)
+{
+	if (htim == &htim6)
+	{
+		hal_current->tim6_running = 1;
+	}
+	else if (htim == &htim7)
+	{
+		hal_current->tim7_running = 1;
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim)
+{
+	return HAL_TIM_Base_Start(htim);
+}
+
+HAL_StatusTypeDef HAL_TIMEx_PWMN_Start(TIM_HandleTypeDef* htim, uint32_t channel)
+{
+	(void) htim;
+	(void) channel;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef* hadc, uint32_t single_diff)
+{
+	(void) hadc;
+	(void) single_diff;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* data, uint32_t length)
+{
+	(void) hadc;
+	hal_current->adc_buffer = data;
+	hal_current->adc_length = length;
+	hal_current->adc_index = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size, uint32_t timeout)
+{
+	(void) huart;
+	(void) timeout;
+	HalInstance* hal = hal_current;
+	if (hal->uart_sink != NULL)
+	{
+		hal->uart_sink(hal->user, data, size);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef* huart)
+{
+	(void) huart;
+	hal_current->uart_tx_pending = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size)
+{
+	(void) huart;
+	HalInstance* hal = hal_current;
+	if (hal->uart_tx_pending)
+	{
+		return HAL_BUSY;
+	}
+	if (hal->uart_sink != NULL)
+	{
+		hal->uart_sink(hal->user, data, size);
+	}
+	hal->uart_tx_pending = 1;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* data, uint16_t size)
+{
+	(void) huart;
+	hal_current->uart_rx_buffer = data;
+	hal_current->uart_rx_size = size;
+	hal_current->uart_rx_index = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+	hal_current->flash_locked = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+	hal_current->flash_locked = 1;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* erase, uint32_t* page_error)
+{
+	HalInstance* hal = hal_current;
+	*page_error = 0xFFFFFFFFu;
+	if (hal->flash_locked || erase->Page != HAL_FLASH_PAGES - 1 || erase->NbPages != 1)
+	{
+		*page_error = erase->Page;
+		return HAL_ERROR;
+	}
+	memset(hal->flash_page, 0xFF, sizeof(hal->flash_page));
+	return HAL_OK;
+}
+
+/**
+ * @brief  Programs a double word of the flash, which like on the target must be erased.
+ */
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t type, uintptr_t address, uint64_t data)
+{
+	(void) type;
+	HalInstance* hal = hal_current;
+	uintptr_t offset = address - (uintptr_t) hal->flash_page;
+	if (hal->flash_locked || offset >= sizeof(hal->flash_page) || offset % sizeof(uint64_t) != 0
+			|| hal->flash_page[offset / sizeof(uint64_t)] != UINT64_MAX)
+	{
+		return HAL_ERROR;
+	}
+	hal->flash_page[offset / sizeof(uint64_t)] = data;
+	return HAL_OK;
+}
+
+/**
+ * @brief  Receives bytes over USART2 like the DMA in circular mode does.
+ *
+ * @param  data received bytes
+ * @param  len number of bytes
+ * @return None
+ */
+void hal_uartReceive(const uint8_t* data, uint32_t len)
+{
+	HalInstance* hal = hal_current;
+	if (hal->uart_rx_buffer == NULL)
+	{
+		return;
+	}
+	for (uint32_t i = 0; i < len; i++)
+	{
+		hal->uart_rx_buffer[hal->uart_rx_index] = data[i];
+		hal->uart_rx_index = (hal->uart_rx_index + 1) % hal->uart_rx_size;
+	}
+	hal->uart_rx_pending = 1;
+}
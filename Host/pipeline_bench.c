@@ -0,0 +1,111 @@
+/**
+ * @brief  Host benchmark of the complete control pipeline of the firmware.
+ *
+ * The unmodified firmware modules run against the HAL stand-in: ADC blocks with filters and
+ * encoder detection, the velocity control and odometry in the TIM7 interrupt and the
+ * behaviour and telemetry jobs at the rates of main.c. The wheels are turned by a simple
+ * motor model, so the encoders produce edges and the controllers have work to do.
+ *
+ * Run it under "perf stat" or "perf record" to look at the cost of single functions.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#include "main.h"
+#include "sensors.h"
+#include "velocity.h"
+#include "odometry.h"
+#include "robot.h"
+
+/* Virtual time that is simulated */
+#define SIMULATED_SECONDS 600
+
+#define BEHAVIOUR_PERIOD_US 5000
+#define TELEMETRY_PERIOD_US 20000
+
+/* Encoder periods per second of a wheel at full duty */
+#define ENCODER_RATE_FULL_DUTY 28.5
+
+static HalInstance hal;
+static RobotContext robot;
+
+static double phase_left = 0;
+static double phase_right = 0;
+static uint64_t last_sample = 0;
+
+/**
+ * @brief  Turns both wheels according to their PWM and samples the sensors.
+ */
+static void sampleSensors(void* user, uint64_t micros, uint16_t* scan)
+{
+	(void) user;
+	double dt = (micros - last_sample) * 1e-6;
+	last_sample = micros;
+
+	double left = hal_pwmDuty(TIM_CHANNEL_2) * ((GPIOA->ODR & phase2_L_Pin) ? -1 : 1);
+	double right = hal_pwmDuty(TIM_CHANNEL_3) * ((GPIOB->ODR & phase2_R_Pin) ? -1 : 1);
+	phase_left += 2 * M_PI * ENCODER_RATE_FULL_DUTY * left * dt;
+	phase_right += 2 * M_PI * ENCODER_RATE_FULL_DUTY * right * dt;
+
+	scan[CH_LINESENSOR_MIDDLE] = 3000;
+	scan[CH_LINESENSOR_LEFT] = 600;
+	scan[CH_LINESENSOR_RIGHT] = 600;
+	scan[CH_BATTERY] = 3100;
+	scan[CH_ENCODER_LEFT] = (uint16_t) (1800 + 1500 * sin(phase_left));
+	scan[CH_ENCODER_RIGHT] = (uint16_t) (1800 + 1500 * sin(phase_right));
+}
+
+/**
+ * @brief  Current time in nanoseconds.
+ */
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main()
+{
+	hal_reset(&hal);
+	hal.adc_sampler = sampleSensors;
+	robot_init(&robot);
+
+	uint64_t steps = 0;
+	uint64_t step_cycles = 0;
+	uint64_t interrupt_cycles = 0;
+	double start = now();
+
+	for (uint64_t t = 0; t < SIMULATED_SECONDS * 1000000ull; t += BEHAVIOUR_PERIOD_US)
+	{
+		uint64_t cycles = __rdtsc();
+		hal_advance(BEHAVIOUR_PERIOD_US);
+		interrupt_cycles += __rdtsc() - cycles;
+
+		cycles = __rdtsc();
+		robot_step(&robot);
+		if (t % TELEMETRY_PERIOD_US == 0)
+		{
+			robot_outputTelemetry(&robot);
+		}
+		step_cycles += __rdtsc() - cycles;
+		steps++;
+	}
+
+	double seconds = (now() - start) * 1e-9;
+	printf("simulated %d s in %.3f s (%.0fx real time)\n", SIMULATED_SECONDS, seconds, SIMULATED_SECONDS / seconds);
+	printf("%-20s %10.0f steps/s\n", "behaviour", steps / seconds);
+	printf("%-20s %10.1f cycles/step\n", "behaviour", (double) step_cycles / steps);
+	printf("%-20s %10.1f cycles/step\n", "interrupts", (double) interrupt_cycles / steps);
+
+	Pose pose;
+	getPose(&robot, &pose);
+	printf("final pose x %.0f mm, y %.0f mm, state %d\n", pose.x, pose.y, robot.current_state);
+	return 0;
+}
@@ -0,0 +1,235 @@
+/**
+ * @brief  Host-side test of the telemetry protocol.
+ *
+ * Checks the COBS framing with payloads of every length up to the largest frame, then sends a
+ * stream of random samples, texts and flight recorder records through a channel that loses and
+ * corrupts frames. Every frame the decoder accepts must match the frame that was sent, and the
+ * decoder must resynchronise at the next key frame. Text frames longer than the encoder
+ * produces must be rejected even with a valid CRC.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "protocol.h"
+
+#define STREAM_FRAMES 20000
+
+/* Probabilities of the channel in percent */
+#define SENDER_DROP   1   /* Frame not sent because the ring was full */
+#define CHANNEL_LOSS  1   /* Frame lost on the line */
+#define CHANNEL_ERROR 1   /* Frame with a flipped bit */
+
+/**
+ * @brief  Encodes and decodes payloads of every length with few, many and no zero bytes.
+ *
+ * @return number of failures
+ */
+static int testCobs()
+{
+	static const int zero_shares[] = {0, 2, 50, 100};
+	uint8_t payload[PROTOCOL_MAX_FRAME];
+	uint8_t frame[PROTOCOL_MAX_FRAME + 8];
+	uint8_t decoded[PROTOCOL_MAX_FRAME + 8];
+	int failures = 0;
+
+	for (unsigned z = 0; z < sizeof(zero_shares) / sizeof(zero_shares[0]); z++)
+	{
+		for (uint32_t len = 1; len <= PROTOCOL_MAX_TEXT + 4; len++)
+		{
+			for (uint32_t i = 0; i < len; i++)
+			{
+				payload[i] = rand() % 100 < zero_shares[z] ? 0 : 1 + rand() % 255;
+			}
+
+			uint32_t frame_len = protocol_cobsEncode(payload, len, frame);
+			int ok = frame_len <= PROTOCOL_MAX_FRAME && frame[frame_len - 1] == 0
+					&& memchr(frame, 0, frame_len - 1) == NULL
+					&& protocol_cobsDecode(frame, frame_len - 1, decoded) == len
+					&& memcmp(payload, decoded, len) == 0;
+			if (!ok)
+			{
+				printf("cobs: length %u, %d%% zeros FAILED\n", len, zero_shares[z]);
+				failures++;
+			}
+		}
+	}
+	return failures;
+}
+
+/**
+ * @brief  Decodes text frames with a valid CRC up to the largest frame, of which only those
+ * 		   with at most PROTOCOL_MAX_TEXT characters are accepted.
+ *
+ * @return number of failures
+ */
+static int testTextLength()
+{
+	static ProtocolMessage message;
+	uint8_t payload[PROTOCOL_MAX_FRAME];
+	uint8_t frame[PROTOCOL_MAX_FRAME + 8];
+	int failures = 0;
+
+	/* Header, text and CRC of the longest payload that still fits a frame */
+	for (uint32_t text_len = PROTOCOL_MAX_TEXT - 1; text_len + 4 <= PROTOCOL_MAX_FRAME - 2; text_len++)
+	{
+		ProtocolStream receiver;
+		protocol_init(&receiver, 0);
+
+		payload[0] = (PROTOCOL_VERSION << 4) | PROTOCOL_TEXT;
+		payload[1] = 0;
+		memset(&payload[2], 'x', text_len);
+		uint16_t crc = protocol_crc16(payload, text_len + 2);
+		payload[text_len + 2] = crc & 0xFF;
+		payload[text_len + 3] = crc >> 8;
+
+		uint32_t frame_len = protocol_cobsEncode(payload, text_len + 4, frame);
+		int32_t type = protocol_decode(&receiver, frame, frame_len - 1, &message);
+		int ok = text_len <= PROTOCOL_MAX_TEXT
+				? type == PROTOCOL_TEXT && message.text_len == text_len
+				: type == PROTOCOL_ERROR_FRAMING;
+		if (!ok)
+		{
+			printf("text: length %u, decoded as %d FAILED\n", text_len, (int) type);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+/**
+ * @brief  Next sample of a random walk with occasional jumps and changes of direction.
+ */
+static void nextSample(ProtocolSample* sample)
+{
+	sample->timestamp += 4000 + rand() % 2000;
+	for (int i = 0; i < PROTOCOL_ADC_CHANNELS; i++)
+	{
+		int32_t value = rand() % 50 == 0 ? rand() % 4096 : sample->adc[i] + rand() % 41 - 20;
+		sample->adc[i] = value < 0 ? 0 : value > 4095 ? 4095 : value;
+	}
+	sample->encoder_left += rand() % 4;
+	sample->encoder_right += rand() % 4;
+	sample->state = rand() % 20 == 0 ? rand() % 5 : sample->state;
+	sample->pwm_left = rand() % 10 == 0 ? rand() % 131072 - 65536 : sample->pwm_left;
+	sample->pwm_right = rand() % 10 == 0 ? rand() % 131072 - 65536 : sample->pwm_right;
+}
+
+/**
+ * @brief  Sends a stream through a lossy channel and compares what is decoded.
+ *
+ * @return number of failures
+ */
+static int testStream()
+{
+	static ProtocolMessage message;
+	ProtocolStream sender, receiver;
+	protocol_init(&sender, PROTOCOL_FIELDS_ALL);
+	protocol_init(&receiver, 0);
+
+	ProtocolSample sample = {0};
+	ProtocolRecord record = {0};
+	uint8_t frame[PROTOCOL_MAX_FRAME];
+	char text[PROTOCOL_MAX_TEXT];
+	unsigned samples = 0, sent = 0, decoded = 0, skipped = 0, rejected = 0, lost = 0;
+	uint64_t sample_bytes = 0, csv_bytes = 0;
+	int failures = 0;
+
+	for (int n = 0; n < STREAM_FRAMES; n++)
+	{
+		int kind = rand() % 50;
+		int is_text = kind == 0;
+		int is_record = kind == 1;
+		uint32_t len;
+		uint32_t text_len = 0;
+		if (is_record)
+		{
+			/* Records are absolute and must not disturb the differences of the samples */
+			nextSample(&record.sample);
+			record.trigger = rand() % 5;
+			record.sub_state = rand() % 6;
+			record.position = rand() % 2048 - 1024;
+			len = protocol_encodeRecord(&sender, &record, frame);
+		}
+		else if (is_text)
+		{
+			text_len = rand() % sizeof(text);
+			for (uint32_t i = 0; i < text_len; i++)
+			{
+				text[i] = 32 + rand() % 95;
+			}
+			len = protocol_encodeText(&sender, text, text_len, frame);
+		}
+		else
+		{
+			nextSample(&sample);
+			len = protocol_encodeSample(&sender, &sample, frame);
+			samples++;
+			sample_bytes += len;
+			csv_bytes += snprintf(text, sizeof(text), "%u,%u,%u,%u,%u,%u,%u,%d,%d,%u,%d,%d\n", sample.timestamp, sample.adc[0],
+					sample.adc[1], sample.adc[2], sample.adc[3], sample.adc[4], sample.adc[5], sample.encoder_left,
+					sample.encoder_right, sample.state, sample.pwm_left, sample.pwm_right);
+		}
+
+		int roll = rand() % 100;
+		if (roll < SENDER_DROP)
+		{
+			/* Like telemetry_sendSample() when the ring is full */
+			protocol_resync(&sender);
+			continue;
+		}
+		sent++;
+		if (roll < SENDER_DROP + CHANNEL_LOSS)
+		{
+			continue;
+		}
+		if (roll < SENDER_DROP + CHANNEL_LOSS + CHANNEL_ERROR)
+		{
+			frame[rand() % (len - 1)] ^= 1 << (rand() % 8);
+		}
+
+		int32_t type = protocol_decode(&receiver, frame, len - 1, &message);
+		if (type < 0)
+		{
+			skipped += type == PROTOCOL_ERROR_NO_KEY;
+			rejected += type != PROTOCOL_ERROR_NO_KEY;
+			continue;
+		}
+
+		decoded++;
+		lost += message.lost;
+		int ok = is_record ? type == PROTOCOL_RECORD && memcmp(&message.record, &record, sizeof(record)) == 0
+				: is_text ? type == PROTOCOL_TEXT && message.text_len == text_len && memcmp(message.text, text, text_len) == 0
+				: type == PROTOCOL_SAMPLE && memcmp(&message.sample, &sample, sizeof(sample)) == 0;
+		if (!ok)
+		{
+			printf("stream: frame %d decoded wrongly FAILED\n", n);
+			failures++;
+		}
+	}
+
+	/* Every frame that was neither lost nor corrupted, nor waited for a key frame, is decoded */
+	unsigned expected = sent * (100 - CHANNEL_LOSS - CHANNEL_ERROR - SENDER_DROP) / (100 - SENDER_DROP);
+	printf("stream: %u sent, %u decoded, %u waited for a key frame, %u rejected, %u reported lost\n", sent, decoded,
+			skipped, rejected, lost);
+	printf("stream: %.1f bytes per sample (CSV %.1f)\n", (double) sample_bytes / samples, (double) csv_bytes / samples);
+	if (decoded + skipped < expected * 9 / 10)
+	{
+		printf("stream: too few frames decoded FAILED\n");
+		failures++;
+	}
+	return failures;
+}
+
+int main()
+{
+	srand(1);
+	int failures = testCobs();
+	failures += testTextLength();
+	failures += testStream();
+	printf("%s\n", failures == 0 ? "protocol ok" : "protocol FAILED");
+	return failures != 0;
+}
@@ -0,0 +1,352 @@
+/**
+ * @brief  Accelerated-time simulation of the Armuro robot on the parkour.
+ *
+ * The unmodified firmware runs against the HAL stand-in. Every ADC scan advances a
+ * differential-drive model by one sample period and samples the floor for the three line
+ * sensors, the analog waveform of both wheel encoders and the battery. The motors follow
+ * their PWM duty with a first-order lag, the bumper reads low while it touches the obstacle.
+ * The behaviour job runs at the rate of main.c.
+ *
+ * Every Sim owns its microcontroller and its robot, so any number of laps can be stepped side
+ * by side as long as each thread works on its own.
+ *
+ * @author Lukas Probst
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "sensors.h"
+#include "velocity.h"
+#include "odometry.h"
+#include "utility.h"
+#include "command.h"
+#include "robot.h"
+#include "sim.h"
+
+/* Geometry of the robot in mm */
+#define SIM_WHEEL_BASE       WHEEL_BASE_MM
+#define SENSOR_FORWARD       40.0f
+#define SENSOR_SIDE          12.0f
+#define SENSOR_SPOT          4.0f
+#define BUMPER_FORWARD       55.0f
+
+/* Motor model */
+#define FULL_DUTY_VELOCITY   ((float) MAX_WHEEL_VELOCITY)
+#define MOTOR_TIME_CONSTANT  0.04f
+
+/* Analog signals in ADC counts */
+#define FLOOR_WHITE_ADC      400.0f
+#define FLOOR_BLACK_ADC      3600.0f
+#define ENCODER_MEAN_ADC     1800.0f
+#define ENCODER_AMPLITUDE    1500.0f
+#define BATTERY_ADC          3100.0f
+
+#define BEHAVIOUR_PERIOD_US  5000
+#define TELEMETRY_PERIOD_US  5000
+#define COMMAND_PERIOD_US    20000
+
+/**
+ * @brief  Uniformly distributed random number in (0, 1] (xorshift32).
+ */
+static float randomUniform(Sim* sim)
+{
+	sim->random_state ^= sim->random_state << 13;
+	sim->random_state ^= sim->random_state >> 17;
+	sim->random_state ^= sim->random_state << 5;
+	return (sim->random_state >> 8) * (1.0f / 16777216.0f) + (1.0f / 33554432.0f);
+}
+
+/**
+ * @brief  Normally distributed noise (Box-Muller).
+ */
+static float randomNoise(Sim* sim, float sigma)
+{
+	if (sigma <= 0)
+	{
+		return 0;
+	}
+	return sigma * sqrtf(-2 * logf(randomUniform(sim))) * cosf(2 * (float) M_PI * randomUniform(sim));
+}
+
+static uint16_t toAdc(Sim* sim, float value)
+{
+	value += randomNoise(sim, sim->config->adc_noise);
+	if (value < 0)
+	{
+		return 0;
+	}
+	if (value > 4095)
+	{
+		return 4095;
+	}
+	return (uint16_t) value;
+}
+
+/**
+ * @brief  Signal of a reflective line sensor at an offset from the axle, averaged over its spot.
+ */
+static uint16_t sampleLineSensor(Sim* sim, float forward, float side)
+{
+	const TrackPose* body = &sim->body;
+	float c = cosf(body->theta);
+	float s = sinf(body->theta);
+	float x = body->x + forward * c - side * s;
+	float y = body->y + forward * s + side * c;
+
+	static const float spot[5][2] = {{0, 0}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+	float brightness = 0;
+	for (int i = 0; i < 5; i++)
+	{
+		brightness += track_brightness(sim->config->track, x + spot[i][0] * SENSOR_SPOT, y + spot[i][1] * SENSOR_SPOT);
+	}
+	brightness /= 5 * 255.0f;
+	return toAdc(sim, FLOOR_BLACK_ADC + brightness * (FLOOR_WHITE_ADC - FLOOR_BLACK_ADC));
+}
+
+/**
+ * @brief  Signal of a wheel encoder: two ticks per period of the stripes.
+ */
+static uint16_t sampleEncoder(Sim* sim, float distance)
+{
+	return toAdc(sim, ENCODER_MEAN_ADC + ENCODER_AMPLITUDE * sinf((float) M_PI * distance / (float) ENCODER_TICK_MM));
+}
+
+/**
+ * @brief  Advances the motors and the body by dt.
+ */
+static void step(Sim* sim, float dt)
+{
+	const SimConfig* config = sim->config;
+	TrackPose* body = &sim->body;
+	float duty_left = hal_pwmDuty(TIM_CHANNEL_2) * ((GPIOA->ODR & phase2_L_Pin) ? -1 : 1);
+	float duty_right = hal_pwmDuty(TIM_CHANNEL_3) * ((GPIOB->ODR & phase2_R_Pin) ? -1 : 1);
+	float alpha = dt / (MOTOR_TIME_CONSTANT + dt);
+	sim->velocity_left += alpha * (duty_left * FULL_DUTY_VELOCITY * config->motor_left - sim->velocity_left);
+	sim->velocity_right += alpha * (duty_right * FULL_DUTY_VELOCITY * config->motor_right - sim->velocity_right);
+
+	float left = sim->velocity_left * dt;
+	float right = sim->velocity_right * dt;
+	float distance = (left + right) / 2;
+	float rotation = (right - left) / SIM_WHEEL_BASE;
+
+	/* The obstacle stops every movement of the bumper towards it */
+	float bx = body->x + BUMPER_FORWARD * cosf(body->theta);
+	float by = body->y + BUMPER_FORWARD * sinf(body->theta);
+	float ox = config->obstacle.x - bx;
+	float oy = config->obstacle.y - by;
+	uint8_t contact = config->obstacle.radius > 0 && ox * ox + oy * oy <= config->obstacle.radius * config->obstacle.radius;
+	if (contact && !sim->touching)
+	{
+		sim->result.collisions++;
+	}
+	sim->touching = contact;
+	if (contact && distance > 0)
+	{
+		distance = 0;
+		left = right = 0;
+		rotation = 0;
+	}
+
+	sim->wheel_left_mm += left;
+	sim->wheel_right_mm += right;
+	float heading = body->theta + rotation / 2;
+	body->x += distance * cosf(heading);
+	body->y += distance * sinf(heading);
+	body->theta += rotation;
+
+	if (sim->touching)
+	{
+		GPIOA->IDR &= ~switch_middle_Pin;
+	}
+	else
+	{
+		GPIOA->IDR |= switch_middle_Pin;
+	}
+}
+
+/**
+ * @brief  Source of the ADC scans of the HAL stand-in.
+ */
+static void sampleSensors(void* user, uint64_t micros, uint16_t* scan)
+{
+	Sim* sim = user;
+	step(sim, (micros - sim->last_sample) * 1e-6f);
+	sim->last_sample = micros;
+
+	scan[CH_LINESENSOR_LEFT] = sampleLineSensor(sim, SENSOR_FORWARD, SENSOR_SIDE);
+	scan[CH_LINESENSOR_MIDDLE] = sampleLineSensor(sim, SENSOR_FORWARD, 0);
+	scan[CH_LINESENSOR_RIGHT] = sampleLineSensor(sim, SENSOR_FORWARD, -SENSOR_SIDE);
+	scan[CH_ENCODER_LEFT] = sampleEncoder(sim, sim->wheel_left_mm);
+	scan[CH_ENCODER_RIGHT] = sampleEncoder(sim, sim->wheel_right_mm);
+	scan[CH_BATTERY] = toAdc(sim, BATTERY_ADC);
+}
+
+/**
+ * @brief  Sink of the bytes sent over USART2.
+ */
+static void writeUart(void* user, const uint8_t* data, uint32_t len)
+{
+	Sim* sim = user;
+	fwrite(data, 1, len, sim->config->uart);
+}
+
+/**
+ * @brief  Makes a simulated robot the one the calling thread works on.
+ */
+static void selectSim(Sim* sim)
+{
+	hal_select(&sim->hal);
+	robot_active = &sim->robot;
+}
+
+/**
+ * @brief  Sets a configuration without noise for a track.
+ *
+ * @param  config receives the configuration
+ * @param  track floor of the course
+ * @return None
+ */
+void sim_defaultConfig(SimConfig* config, const Track* track)
+{
+	memset(config, 0, sizeof(*config));
+	config->track = track;
+	config->time_limit = 120;
+	config->motor_left = 1;
+	config->motor_right = 1;
+	config->seed = 1;
+}
+
+/**
+ * @brief  Puts a simulated robot at the start and powers up its microcontroller.
+ *
+ * @param  sim robot to start
+ * @param  config course and variations, must stay valid until the lap is over
+ * @return None
+ */
+void sim_start(Sim* sim, const SimConfig* config)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->config = config;
+	sim->body = config->start;
+	sim->random_state = config->seed != 0 ? config->seed : 1;
+	sim->limit = (uint64_t) (config->time_limit * 1e6f);
+	sim->running = 1;
+
+	hal_reset(&sim->hal);
+	sim->hal.adc_sampler = sampleSensors;
+	sim->hal.user = sim;
+	if (config->uart != NULL)
+	{
+		sim->hal.uart_sink = writeUart;
+	}
+	robot_init(&sim->robot);
+	if (config->params != NULL)
+	{
+		sim->robot.params = *config->params;
+		setNormalSpeed(&sim->robot);
+	}
+	sim->previous_state = sim->robot.current_state;
+}
+
+/**
+ * @brief  Simulates one behaviour period of a robot.
+ *
+ * @param  sim robot to advance
+ * @return 1 while the lap goes on, 0 once the robot stopped after the finish line or the
+ * 		   time limit is reached
+ */
+uint8_t sim_step(Sim* sim)
+{
+	if (!sim->running)
+	{
+		return 0;
+	}
+
+	selectSim(sim);
+	RobotContext* robot = &sim->robot;
+	hal_advance(BEHAVIOUR_PERIOD_US);
+
+	while (sim->next_command < sim->config->command_count
+			&& hal_micros() >= (uint64_t) (sim->config->commands[sim->next_command].time * 1e6f))
+	{
+		const char* line = sim->config->commands[sim->next_command++].line;
+		hal_uartReceive((const uint8_t*) line, strlen(line));
+		hal_uartReceive((const uint8_t*) "\n", 1);
+	}
+
+	robot_step(robot);
+	if (sim->config->uart != NULL && hal_micros() % TELEMETRY_PERIOD_US == 0)
+	{
+		robot_outputTelemetry(robot);
+	}
+	if (hal_micros() % COMMAND_PERIOD_US == 0)
+	{
+		command_poll(robot);
+	}
+
+	if (sim->config->trace != NULL)
+	{
+		fprintf(sim->config->trace, "%.3f,%.1f,%.1f,%.1f,%d\n", hal_micros() * 1e-6f, sim->body.x, sim->body.y, sim->body.theta * 180 / (float) M_PI, robot->current_state);
+	}
+
+	if (robot->current_state == SEARCH_LINE && sim->previous_state != SEARCH_LINE)
+	{
+		sim->result.line_losses++;
+	}
+	sim->previous_state = robot->current_state;
+
+	if (robot->current_state == FINISH_LINE && robot->velocity.left.target == 0 && robot->velocity.right.target == 0)
+	{
+		sim->result.finished = 1;
+		sim->running = 0;
+	}
+	else if (hal_micros() >= sim->limit)
+	{
+		sim->running = 0;
+	}
+	return sim->running;
+}
+
+/**
+ * @brief  Outcome of the lap of a robot so far.
+ *
+ * @param  sim simulated robot
+ * @param  result receives the outcome
+ * @return None
+ */
+void sim_result(Sim* sim, SimResult* result)
+{
+	selectSim(sim);
+	Pose odometry;
+	getPose(&sim->robot, &odometry);
+
+	*result = sim->result;
+	result->lap_time = hal_micros() * 1e-6f;
+	result->pose = sim->body;
+	result->odometry.x = odometry.x;
+	result->odometry.y = odometry.y;
+	result->odometry.theta = odometry.theta;
+	result->state = sim->robot.current_state;
+}
+
+/**
+ * @brief  Simulates one lap from the start until the robot stops after the finish line or
+ * 		   the time limit is reached.
+ *
+ * @param  config course and variations
+ * @param  result receives the outcome
+ * @return None
+ */
+void sim_run(const SimConfig* config, SimResult* result)
+{
+	Sim* sim = malloc(sizeof(Sim));
+	sim_start(sim, config);
+	while (sim_step(sim))
+	{
+	}
+	sim_result(sim, result);
+	free(sim);
+}
@@ -0,0 +1,81 @@
+/**
+ * @brief  Header file for sim.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "robot.h"
+#include "track.h"
+
+/* Command line sent to the robot over USART2 during a lap */
+typedef struct
+{
+	float time;            /* Simulated seconds after the start */
+	const char* line;      /* Command without the newline */
+} SimCommand;
+
+/* Course and physical variations of one simulated lap */
+typedef struct
+{
+	const Track* track;
+	TrackPose start;
+	Obstacle obstacle;
+	float time_limit;      /* Simulated seconds until the lap is aborted */
+	float adc_noise;       /* Standard deviation of the noise on every ADC channel */
+	float motor_left;      /* Speed of the left motor relative to the nominal one */
+	float motor_right;     /* Speed of the right motor relative to the nominal one */
+	uint32_t seed;         /* Seed of the noise */
+	const Params* params;  /* Parameters of the firmware, default_params if not set */
+	FILE* trace;           /* If set, receives time, pose and state of every behaviour step as CSV */
+	FILE* uart;            /* If set, the telemetry job runs and this receives the bytes sent over USART2 */
+	const SimCommand* commands;  /* Sent in the order of the array, which is sorted by time */
+	uint32_t command_count;
+} SimConfig;
+
+/* Outcome of one simulated lap */
+typedef struct
+{
+	uint8_t finished;      /* The robot stopped after the finish line */
+	float lap_time;        /* Simulated seconds until the stop or the time limit */
+	uint32_t line_losses;  /* Number of times the robot started to search the line */
+	uint32_t collisions;   /* Number of times the bumper touched the obstacle */
+	TrackPose pose;        /* Final pose on the track */
+	TrackPose odometry;    /* Final pose according to the odometry, relative to the start */
+	uint32_t state;        /* Final RaceState */
+} SimResult;
+
+/* One simulated robot: the microcontroller running the firmware and the physics around it */
+typedef struct
+{
+	const SimConfig* config;
+	HalInstance hal;
+	RobotContext robot;
+
+	TrackPose body;
+	float velocity_left;   /* Velocity of the wheels in mm/s */
+	float velocity_right;
+	float wheel_left_mm;   /* Distance each wheel has rolled */
+	float wheel_right_mm;
+	uint64_t last_sample;  /* Virtual time of the last scan in us */
+	uint8_t touching;      /* The bumper touches the obstacle */
+	uint32_t random_state;
+	uint64_t limit;        /* Virtual time at which the lap is aborted in us */
+	RaceState previous_state;
+	uint32_t next_command; /* Index of the next command to send */
+	uint8_t running;
+	SimResult result;
+} Sim;
+
+void sim_defaultConfig(SimConfig* config, const Track* track);
+void sim_start(Sim* sim, const SimConfig* config);
+uint8_t sim_step(Sim* sim);
+void sim_result(Sim* sim, SimResult* result);
+void sim_run(const SimConfig* config, SimResult* result);
+
+#endif /* __SIM_H__ */
@@ -0,0 +1,137 @@
+/**
+ * @brief  Command line front end of the simulator: runs one lap and prints the outcome.
+ *
+ * Usage: simulate [-t track.pgm -s mm_per_pixel -p x,y,degree -o x,y,radius] [-n noise]
+ * 		  [-m left,right] [-r seed] [-v trace.csv] [-u telemetry.bin] [-k seconds:command ...]
+ *
+ * Without a track image the generated parkour of track.c is used. Every -k sends a command
+ * line over USART2 at the given time, the replies are part of the -u output.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define MAX_COMMANDS 16
+
+static const char* state_names[] = {"FOLLOW_TRAJECTORY", "FOLLOW_LINE", "SEARCH_LINE", "AVOID_OBSTACLE", "FINISH_LINE", "CALIBRATE_LINE"};
+
+int main(int argc, char** argv)
+{
+	const char* track_path = NULL;
+	float mm_per_pixel = 1189.0f / 2872.0f;
+	TrackPose start = {0};
+	Obstacle obstacle = {0};
+	float noise = 0, motor_left = 1, motor_right = 1;
+	uint32_t seed = 1;
+	FILE* trace = NULL;
+	FILE* uart = NULL;
+	SimCommand commands[MAX_COMMANDS];
+	uint32_t command_count = 0;
+	float degree;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:s:p:o:n:m:r:v:u:k:")) != -1)
+	{
+		switch (opt)
+		{
+			case 't': track_path = optarg; break;
+			case 's': mm_per_pixel = atof(optarg); break;
+			case 'p':
+				sscanf(optarg, "%f,%f,%f", &start.x, &start.y, &degree);
+				start.theta = degree * (float) M_PI / 180;
+				break;
+			case 'o': sscanf(optarg, "%f,%f,%f", &obstacle.x, &obstacle.y, &obstacle.radius); break;
+			case 'n': noise = atof(optarg); break;
+			case 'm': sscanf(optarg, "%f,%f", &motor_left, &motor_right); break;
+			case 'r': seed = strtoul(optarg, NULL, 0); break;
+			case 'v':
+				trace = fopen(optarg, "w");
+				if (trace == NULL)
+				{
+					fprintf(stderr, "cannot write %s\n", optarg);
+					return 2;
+				}
+				break;
+			case 'u':
+				uart = fopen(optarg, "wb");
+				if (uart == NULL)
+				{
+					fprintf(stderr, "cannot write %s\n", optarg);
+					return 2;
+				}
+				break;
+			case 'k':
+				if (command_count == MAX_COMMANDS || strchr(optarg, ':') == NULL)
+				{
+					fprintf(stderr, "at most %d commands as seconds:command\n", MAX_COMMANDS);
+					return 2;
+				}
+				commands[command_count].time = atof(optarg);
+				commands[command_count++].line = strchr(optarg, ':') + 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-t track.pgm -s mm_per_pixel -p x,y,degree -o x,y,radius] [-n noise] [-m left,right] [-r seed] [-v trace.csv] [-u telemetry.bin] [-k seconds:command ...]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	Track track;
+	if (track_path != NULL)
+	{
+		if (track_loadPgm(&track, track_path, mm_per_pixel) != 0)
+		{
+			fprintf(stderr, "cannot read %s\n", track_path);
+			return 2;
+		}
+	}
+	else
+	{
+		track_generateParkour(&track, &start, &obstacle);
+	}
+
+	SimConfig config;
+	sim_defaultConfig(&config, &track);
+	config.start = start;
+	config.obstacle = obstacle;
+	config.adc_noise = noise;
+	config.motor_left = motor_left;
+	config.motor_right = motor_right;
+	config.seed = seed;
+	config.trace = trace;
+	config.uart = uart;
+	config.commands = commands;
+	config.command_count = command_count;
+
+	SimResult result;
+	clock_t begin = clock();
+	sim_run(&config, &result);
+	double seconds = (double) (clock() - begin) / CLOCKS_PER_SEC;
+
+	printf("finished      %s\n", result.finished ? "yes" : "no");
+	printf("lap time      %.2f s\n", result.lap_time);
+	printf("line losses   %u\n", result.line_losses);
+	printf("collisions    %u\n", result.collisions);
+	printf("final state   %s\n", state_names[result.state]);
+	printf("final pose    x %.0f mm, y %.0f mm, heading %.0f degree\n", result.pose.x, result.pose.y, result.pose.theta * 180 / M_PI);
+	printf("odometry      x %.0f mm, y %.0f mm, heading %.0f degree\n", result.odometry.x, result.odometry.y, result.odometry.theta * 180 / M_PI);
+	printf("wall time     %.3f s (%.0fx real time)\n", seconds, result.lap_time / seconds);
+
+	if (trace != NULL)
+	{
+		fclose(trace);
+	}
+	if (uart != NULL)
+	{
+		fclose(uart);
+	}
+	track_free(&track);
+	return result.finished ? 0 : 1;
+}
@@ -0,0 +1,695 @@
+/**
+ * @brief  Parallel parameter sweep and optimiser over simulated laps.
+ *
+ * Every candidate set of parameters is driven through the same variations of the course
+ * (sensor noise, motor mismatch, start pose). Each lap runs in its own forked process, so the
+ * laps are isolated from each other and use all cores. A candidate is rated by its mean lap
+ * time over the finished laps and by its robustness, the share of variations it finishes.
+ * All rated candidates are written as CSV, the Pareto front of both criteria is printed.
+ *
+ * Usage: sweep [-s grid|random|cmaes] [-n count] [-d name,name,...] [-k variations]
+ * 		 [-j workers] [-r seed] [-o results.csv]
+ *
+ * For grid, count is the number of levels per dimension, for random the number of candidates
+ * and for cmaes the number of generations.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "params.h"
+#include "sim.h"
+
+#define MAX_DIMENSIONS 24
+#define MAX_VARIATIONS 64
+
+typedef enum {KIND_Q16, KIND_U16, KIND_FLOAT} Kind;
+
+/* Parameter that can be swept with its range */
+typedef struct
+{
+	const char* name;
+	Kind kind;
+	size_t offset;
+	double min;
+	double max;
+} Dimension;
+
+#define DIMENSION(field, kind, min, max) {#field, kind, offsetof(Params, field), min, max}
+
+static const Dimension dimensions[] =
+{
+	DIMENSION(line_gain, KIND_Q16, 32, 384),
+	DIMENSION(straight_gain, KIND_Q16, 0.0, 0.4),
+	DIMENSION(encoder_left_high, KIND_U16, 2000, 3200),
+	DIMENSION(encoder_left_low, KIND_U16, 500, 1600),
+	DIMENSION(encoder_right_high, KIND_U16, 2000, 3200),
+	DIMENSION(encoder_right_low, KIND_U16, 500, 1600),
+	DIMENSION(black_level, KIND_Q16, 0.09, 0.66),
+	DIMENSION(first_straight_length, KIND_FLOAT, 430, 510),
+	DIMENSION(right_curve_degree, KIND_FLOAT, 130, 170),
+	DIMENSION(second_straight_length, KIND_FLOAT, 315, 395),
+	DIMENSION(left_curve_degree, KIND_FLOAT, 70, 110),
+	DIMENSION(third_straight_length, KIND_FLOAT, 280, 360),
+	DIMENSION(half_perimeter_degree, KIND_FLOAT, 60, 140),
+	DIMENSION(next_perimeter_length, KIND_FLOAT, 40, 120),
+	DIMENSION(obstacle_reverse_length, KIND_FLOAT, 10, 60),
+	DIMENSION(obstacle_turn_degree, KIND_FLOAT, 30, 80),
+	DIMENSION(last_part_indication, KIND_FLOAT, 200, 600),
+	DIMENSION(finish_line_spurt, KIND_FLOAT, 50, 200),
+};
+
+#define DIMENSION_COUNT (sizeof(dimensions) / sizeof(dimensions[0]))
+
+/* Outcome of a candidate over all variations */
+typedef struct
+{
+	double lap_time;
+	double robustness;
+} Rating;
+
+static const Dimension* selected[MAX_DIMENSIONS];
+static int dimension_count = 0;
+
+static SimConfig variations[MAX_VARIATIONS];
+static int variation_count = 8;
+static int workers = 0;
+
+static FILE* output;
+static double* history = NULL;
+static Rating* history_ratings = NULL;
+static int history_count = 0;
+
+/**
+ * @brief  Uniformly distributed random number in [0, 1).
+ */
+static double randomUniform()
+{
+	return rand() / (RAND_MAX + 1.0);
+}
+
+/**
+ * @brief  Normally distributed random number.
+ */
+static double randomGaussian()
+{
+	return sqrt(-2 * log(1 - randomUniform())) * cos(2 * M_PI * randomUniform());
+}
+
+/**
+ * @brief  Writes the value of a dimension, given relative to its range in [0, 1], into a set of parameters.
+ */
+static void applyDimension(Params* target, const Dimension* dimension, double relative)
+{
+	relative = fmin(fmax(relative, 0), 1);
+	double value = dimension->min + relative * (dimension->max - dimension->min);
+	void* field = (char*) target + dimension->offset;
+	switch (dimension->kind)
+	{
+		case KIND_Q16:
+			*(q16_t*) field = (q16_t) lround(value * Q16_ONE);
+			break;
+		case KIND_U16:
+			*(uint16_t*) field = (uint16_t) lround(value);
+			break;
+		case KIND_FLOAT:
+			*(float*) field = (float) value;
+			break;
+	}
+}
+
+static double readDimension(const Params* source, const Dimension* dimension)
+{
+	const void* field = (const char*) source + dimension->offset;
+	switch (dimension->kind)
+	{
+		case KIND_Q16:
+			return *(const q16_t*) field / (double) Q16_ONE;
+		case KIND_U16:
+			return *(const uint16_t*) field;
+		default:
+			return *(const float*) field;
+	}
+}
+
+/**
+ * @brief  Variations of the course every candidate is driven through. The first one is the
+ * 		   nominal course without noise.
+ */
+static void makeVariations(const Track* track, const TrackPose* start, const Obstacle* obstacle)
+{
+	for (int i = 0; i < variation_count; i++)
+	{
+		SimConfig* config = &variations[i];
+		sim_defaultConfig(config, track);
+		config->start = *start;
+		config->obstacle = *obstacle;
+		config->seed = i + 1;
+		if (i == 0)
+		{
+			continue;
+		}
+		config->adc_noise = 80 * randomUniform();
+		config->motor_left = 1 + 0.08 * (2 * randomUniform() - 1);
+		config->motor_right = 1 + 0.08 * (2 * randomUniform() - 1);
+		config->start.x += 5 * (2 * randomUniform() - 1);
+		config->start.theta += (float) (2 * M_PI / 180 * (2 * randomUniform() - 1));
+		config->obstacle.radius *= 1 + 0.2 * (2 * randomUniform() - 1);
+	}
+}
+
+/**
+ * @brief  Rates a batch of candidates, running up to workers laps at the same time.
+ *
+ * @param  points candidates as rows of dimension_count relative values
+ * @param  count number of candidates
+ * @param  ratings receives one rating per candidate
+ */
+static void rate(const double* points, int count, Rating* ratings)
+{
+	int jobs = count * variation_count;
+	SimResult* results = calloc(jobs, sizeof(SimResult));
+	pid_t* pids = calloc(jobs, sizeof(pid_t));
+	int* pipes = calloc(jobs, sizeof(int));
+	int next = 0;
+	int running = 0;
+
+	while (next < jobs || running > 0)
+	{
+		while (next < jobs && running < workers)
+		{
+			int fd[2];
+			if (pipe(fd) != 0)
+			{
+				perror("pipe");
+				exit(2);
+			}
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				/* A crashing lap only takes its own process down */
+				close(fd[0]);
+				const double* point = &points[(next / variation_count) * dimension_count];
+				Params candidate = default_params;
+				for (int d = 0; d < dimension_count; d++)
+				{
+					applyDimension(&candidate, selected[d], point[d]);
+				}
+				SimConfig config = variations[next % variation_count];
+				config.params = &candidate;
+				SimResult result;
+				sim_run(&config, &result);
+				ssize_t written = write(fd[1], &result, sizeof(result));
+				_exit(written == sizeof(result) ? 0 : 1);
+			}
+			close(fd[1]);
+			pids[next] = pid;
+			pipes[next] = fd[0];
+			next++;
+			running++;
+		}
+
+		pid_t pid = wait(NULL);
+		for (int i = 0; i < next; i++)
+		{
+			if (pids[i] == pid)
+			{
+				if (read(pipes[i], &results[i], sizeof(SimResult)) != sizeof(SimResult))
+				{
+					memset(&results[i], 0, sizeof(SimResult));
+				}
+				close(pipes[i]);
+				pids[i] = 0;
+				running--;
+				break;
+			}
+		}
+	}
+
+	for (int c = 0; c < count; c++)
+	{
+		double time = 0;
+		int finished = 0;
+		for (int v = 0; v < variation_count; v++)
+		{
+			const SimResult* result = &results[c * variation_count + v];
+			if (result->finished)
+			{
+				time += result->lap_time;
+				finished++;
+			}
+		}
+		ratings[c].robustness = (double) finished / variation_count;
+		ratings[c].lap_time = finished > 0 ? time / finished : variations[0].time_limit;
+	}
+
+	/* Keep every rated candidate for the CSV and the Pareto front */
+	history = realloc(history, (history_count + count) * dimension_count * sizeof(double));
+	history_ratings = realloc(history_ratings, (history_count + count) * sizeof(Rating));
+	memcpy(&history[history_count * dimension_count], points, count * dimension_count * sizeof(double));
+	memcpy(&history_ratings[history_count], ratings, count * sizeof(Rating));
+	history_count += count;
+
+	free(results);
+	free(pids);
+	free(pipes);
+}
+
+/**
+ * @brief  Scalar objective for the optimiser: the lap time plus a penalty per missed lap.
+ */
+static double objective(const Rating* rating)
+{
+	return rating->lap_time + 100 * (1 - rating->robustness);
+}
+
+static void strategyGrid(int levels)
+{
+	int count = 1;
+	for (int d = 0; d < dimension_count; d++)
+	{
+		count *= levels;
+	}
+	double* points = malloc(count * dimension_count * sizeof(double));
+	for (int c = 0; c < count; c++)
+	{
+		int index = c;
+		for (int d = 0; d < dimension_count; d++)
+		{
+			points[c * dimension_count + d] = levels > 1 ? (double) (index % levels) / (levels - 1) : 0.5;
+			index /= levels;
+		}
+	}
+	Rating* ratings = malloc(count * sizeof(Rating));
+	rate(points, count, ratings);
+	free(points);
+	free(ratings);
+}
+
+static void strategyRandom(int count)
+{
+	double* points = malloc(count * dimension_count * sizeof(double));
+	for (int i = 0; i < count * dimension_count; i++)
+	{
+		points[i] = randomUniform();
+	}
+	Rating* ratings = malloc(count * sizeof(Rating));
+	rate(points, count, ratings);
+	free(points);
+	free(ratings);
+}
+
+/**
+ * @brief  Eigendecomposition of a symmetric matrix with the cyclic Jacobi method.
+ *
+ * @param  a matrix, destroyed
+ * @param  vectors receives the eigenvectors as columns
+ * @param  values receives the eigenvalues
+ */
+static void eigen(int n, double* a, double* vectors, double* values)
+{
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			vectors[i * n + j] = i == j;
+		}
+	}
+
+	for (int sweep = 0; sweep < 50; sweep++)
+	{
+		double off = 0;
+		for (int p = 0; p < n; p++)
+		{
+			for (int q = p + 1; q < n; q++)
+			{
+				off += a[p * n + q] * a[p * n + q];
+			}
+		}
+		if (off < 1e-20)
+		{
+			break;
+		}
+
+		for (int p = 0; p < n; p++)
+		{
+			for (int q = p + 1; q < n; q++)
+			{
+				if (fabs(a[p * n + q]) < 1e-30)
+				{
+					continue;
+				}
+				double theta = (a[q * n + q] - a[p * n + p]) / (2 * a[p * n + q]);
+				double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+				double c = 1 / sqrt(t * t + 1);
+				double s = t * c;
+				for (int k = 0; k < n; k++)
+				{
+					double akp = a[k * n + p];
+					double akq = a[k * n + q];
+					a[k * n + p] = c * akp - s * akq;
+					a[k * n + q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < n; k++)
+				{
+					double apk = a[p * n + k];
+					double aqk = a[q * n + k];
+					a[p * n + k] = c * apk - s * aqk;
+					a[q * n + k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < n; k++)
+				{
+					double vkp = vectors[k * n + p];
+					double vkq = vectors[k * n + q];
+					vectors[k * n + p] = c * vkp - s * vkq;
+					vectors[k * n + q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		values[i] = fmax(a[i * n + i], 1e-20);
+	}
+}
+
+/**
+ * @brief  (mu/mu_w, lambda)-CMA-ES in the normalised parameter box, starting at the defaults.
+ */
+static void strategyCmaes(int generations)
+{
+	int n = dimension_count;
+	int lambda = 4 + (int) (3 * log(n));
+	int mu = lambda / 2;
+
+	double weights[lambda];
+	double weight_sum = 0, weight_square_sum = 0;
+	for (int i = 0; i < mu; i++)
+	{
+		weights[i] = log(mu + 0.5) - log(i + 1);
+		weight_sum += weights[i];
+	}
+	for (int i = 0; i < mu; i++)
+	{
+		weights[i] /= weight_sum;
+		weight_square_sum += weights[i] * weights[i];
+	}
+	double mu_eff = 1 / weight_square_sum;
+
+	double cc = (4 + mu_eff / n) / (n + 4 + 2 * mu_eff / n);
+	double cs = (mu_eff + 2) / (n + mu_eff + 5);
+	double c1 = 2 / ((n + 1.3) * (n + 1.3) + mu_eff);
+	double cmu = fmin(1 - c1, 2 * (mu_eff - 2 + 1 / mu_eff) / ((n + 2) * (n + 2) + mu_eff));
+	double damps = 1 + 2 * fmax(0, sqrt((mu_eff - 1) / (n + 1)) - 1) + cs;
+	double chi_n = sqrt(n) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+	double mean[n], pc[n], ps[n], values[n];
+	double C[n * n], B[n * n], work[n * n];
+	double sigma = 0.3;
+
+	const Params* defaults = &default_params;
+	for (int i = 0; i < n; i++)
+	{
+		mean[i] = (readDimension(defaults, selected[i]) - selected[i]->min) / (selected[i]->max - selected[i]->min);
+		pc[i] = ps[i] = 0;
+		for (int j = 0; j < n; j++)
+		{
+			C[i * n + j] = i == j;
+		}
+	}
+
+	double* z = malloc(lambda * n * sizeof(double));
+	double* x = malloc(lambda * n * sizeof(double));
+	Rating* ratings = malloc(lambda * sizeof(Rating));
+	int order[lambda];
+
+	for (int generation = 0; generation < generations; generation++)
+	{
+		memcpy(work, C, sizeof(C));
+		eigen(n, work, B, values);
+
+		/* x = mean + sigma * B * D * z */
+		for (int k = 0; k < lambda; k++)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				z[k * n + i] = randomGaussian();
+			}
+			for (int i = 0; i < n; i++)
+			{
+				double y = 0;
+				for (int j = 0; j < n; j++)
+				{
+					y += B[i * n + j] * sqrt(values[j]) * z[k * n + j];
+				}
+				x[k * n + i] = mean[i] + sigma * y;
+			}
+		}
+
+		rate(x, lambda, ratings);
+
+		for (int k = 0; k < lambda; k++)
+		{
+			order[k] = k;
+		}
+		for (int a = 1; a < lambda; a++)
+		{
+			for (int b = a; b > 0 && objective(&ratings[order[b]]) < objective(&ratings[order[b - 1]]); b--)
+			{
+				int t = order[b];
+				order[b] = order[b - 1];
+				order[b - 1] = t;
+			}
+		}
+
+		double old_mean[n], y_w[n], z_w[n];
+		memcpy(old_mean, mean, sizeof(mean));
+		for (int i = 0; i < n; i++)
+		{
+			mean[i] = 0;
+			z_w[i] = 0;
+			for (int k = 0; k < mu; k++)
+			{
+				mean[i] += weights[k] * x[order[k] * n + i];
+				z_w[i] += weights[k] * z[order[k] * n + i];
+			}
+			y_w[i] = (mean[i] - old_mean[i]) / sigma;
+		}
+
+		/* ps = (1 - cs) ps + sqrt(cs (2 - cs) mu_eff) B z_w */
+		double ps_norm = 0;
+		for (int i = 0; i < n; i++)
+		{
+			double bz = 0;
+			for (int j = 0; j < n; j++)
+			{
+				bz += B[i * n + j] * z_w[j];
+			}
+			ps[i] = (1 - cs) * ps[i] + sqrt(cs * (2 - cs) * mu_eff) * bz;
+			ps_norm += ps[i] * ps[i];
+		}
+		ps_norm = sqrt(ps_norm);
+		int hsig = ps_norm / sqrt(1 - pow(1 - cs, 2 * (generation + 1))) / chi_n < 1.4 + 2.0 / (n + 1);
+
+		for (int i = 0; i < n; i++)
+		{
+			pc[i] = (1 - cc) * pc[i] + hsig * sqrt(cc * (2 - cc) * mu_eff) * y_w[i];
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			for (int j = 0; j < n; j++)
+			{
+				double rank_mu = 0;
+				for (int k = 0; k < mu; k++)
+				{
+					double yi = (x[order[k] * n + i] - old_mean[i]) / sigma;
+					double yj = (x[order[k] * n + j] - old_mean[j]) / sigma;
+					rank_mu += weights[k] * yi * yj;
+				}
+				C[i * n + j] = (1 - c1 - cmu) * C[i * n + j]
+						+ c1 * (pc[i] * pc[j] + (1 - hsig) * cc * (2 - cc) * C[i * n + j])
+						+ cmu * rank_mu;
+			}
+		}
+
+		sigma *= exp((cs / damps) * (ps_norm / chi_n - 1));
+		sigma = fmin(sigma, 1);
+
+		const Rating* best = &ratings[order[0]];
+		fprintf(stderr, "generation %d: best lap %.2f s, robustness %.2f, sigma %.3f\n", generation, best->lap_time, best->robustness, sigma);
+	}
+
+	free(z);
+	free(x);
+	free(ratings);
+}
+
+/**
+ * @brief  Writes every rated candidate with its parameter values as a CSV line.
+ */
+static void writeCsv()
+{
+	for (int d = 0; d < dimension_count; d++)
+	{
+		fprintf(output, "%s,", selected[d]->name);
+	}
+	fprintf(output, "lap_time,robustness\n");
+
+	for (int c = 0; c < history_count; c++)
+	{
+		for (int d = 0; d < dimension_count; d++)
+		{
+			const Dimension* dimension = selected[d];
+			double relative = fmin(fmax(history[c * dimension_count + d], 0), 1);
+			fprintf(output, "%g,", dimension->min + relative * (dimension->max - dimension->min));
+		}
+		fprintf(output, "%.3f,%.3f\n", history_ratings[c].lap_time, history_ratings[c].robustness);
+	}
+}
+
+/**
+ * @brief  Prints the candidates that no other candidate beats in both lap time and robustness.
+ */
+static void printParetoFront()
+{
+	printf("Pareto front (lap time vs. robustness):\n");
+	for (int c = 0; c < history_count; c++)
+	{
+		const Rating* a = &history_ratings[c];
+		int dominated = 0;
+		for (int o = 0; o < history_count && !dominated; o++)
+		{
+			const Rating* b = &history_ratings[o];
+			dominated = b->lap_time <= a->lap_time && b->robustness >= a->robustness
+					&& (b->lap_time < a->lap_time || b->robustness > a->robustness);
+		}
+		if (dominated || a->robustness == 0)
+		{
+			continue;
+		}
+
+		printf("  %7.2f s  %4.0f %%  ", a->lap_time, a->robustness * 100);
+		for (int d = 0; d < dimension_count; d++)
+		{
+			const Dimension* dimension = selected[d];
+			double relative = fmin(fmax(history[c * dimension_count + d], 0), 1);
+			printf(" %s=%g", dimension->name, dimension->min + relative * (dimension->max - dimension->min));
+		}
+		printf("\n");
+	}
+}
+
+static int selectDimensions(char* names)
+{
+	for (char* name = strtok(names, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		unsigned i;
+		for (i = 0; i < DIMENSION_COUNT; i++)
+		{
+			if (strcmp(dimensions[i].name, name) == 0)
+			{
+				break;
+			}
+		}
+		if (i == DIMENSION_COUNT || dimension_count == MAX_DIMENSIONS)
+		{
+			fprintf(stderr, "unknown parameter %s\n", name);
+			return -1;
+		}
+		selected[dimension_count++] = &dimensions[i];
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* strategy = "random";
+	char default_dimensions[] = "line_gain,straight_gain,half_perimeter_degree,obstacle_turn_degree";
+	char* names = default_dimensions;
+	int count = -1;
+	unsigned seed = 1;
+	const char* output_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:n:d:k:j:r:o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': strategy = optarg; break;
+			case 'n': count = atoi(optarg); break;
+			case 'd': names = optarg; break;
+			case 'k': variation_count = atoi(optarg); break;
+			case 'j': workers = atoi(optarg); break;
+			case 'r': seed = strtoul(optarg, NULL, 0); break;
+			case 'o': output_path = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-s grid|random|cmaes] [-n count] [-d name,...] [-k variations] [-j workers] [-r seed] [-o results.csv]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	if (selectDimensions(names) != 0)
+	{
+		return 2;
+	}
+	if (variation_count < 1 || variation_count > MAX_VARIATIONS)
+	{
+		fprintf(stderr, "between 1 and %d variations\n", MAX_VARIATIONS);
+		return 2;
+	}
+	if (workers <= 0)
+	{
+		workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	srand(seed);
+
+	output = stdout;
+	if (output_path != NULL && (output = fopen(output_path, "w")) == NULL)
+	{
+		fprintf(stderr, "cannot write %s\n", output_path);
+		return 2;
+	}
+
+	Track track;
+	TrackPose start;
+	Obstacle obstacle;
+	track_generateParkour(&track, &start, &obstacle);
+	makeVariations(&track, &start, &obstacle);
+
+	if (strcmp(strategy, "grid") == 0)
+	{
+		strategyGrid(count > 0 ? count : 3);
+	}
+	else if (strcmp(strategy, "random") == 0)
+	{
+		strategyRandom(count > 0 ? count : 64);
+	}
+	else if (strcmp(strategy, "cmaes") == 0)
+	{
+		strategyCmaes(count > 0 ? count : 20);
+	}
+	else
+	{
+		fprintf(stderr, "unknown strategy %s\n", strategy);
+		return 2;
+	}
+
+	writeCsv();
+	if (output != stdout)
+	{
+		fclose(output);
+	}
+	printParetoFront();
+
+	track_free(&track);
+	return 0;
+}
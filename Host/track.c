@@ -0,0 +1,240 @@
+/**
+ * @brief  Floor of the parkour for the simulator, either loaded from a PGM image or generated.
+ *
+ * A photo of the course such as parkour.jpg can be converted with
+ * "convert parkour.jpg -colorspace gray -depth 8 parkour.pgm". The generated track has the same
+ * sequence of sections as the real course: the blind yellow trajectory from the start, a line
+ * with curves and a gap, an obstacle on the line and the grey finish line at its end.
+ *
+ * @author Lukas Probst
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "track.h"
+
+/* Properties of the generated track in mm */
+#define GENERATED_WIDTH  2200
+#define GENERATED_HEIGHT 1800
+#define LINE_WIDTH       15
+#define GAP_LENGTH       50
+#define OBSTACLE_RADIUS  35
+#define FINISH_LENGTH    120
+#define FINISH_GREY      140
+
+/**
+ * @brief  Reads a binary (P5) PGM image with 8 bit per pixel.
+ *
+ * @param  track receives the image
+ * @param  path file name of the image
+ * @param  mm_per_pixel size of a pixel on the floor
+ * @return 0 on success, -1 if the file cannot be read
+ */
+int track_loadPgm(Track* track, const char* path, float mm_per_pixel)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		return -1;
+	}
+
+	char magic[3] = {0};
+	unsigned width, height, max_value;
+	if (fscanf(file, "%2s", magic) != 1 || strcmp(magic, "P5") != 0)
+	{
+		fclose(file);
+		return -1;
+	}
+	/* Skip comments between the header fields */
+	int c;
+	while ((c = fgetc(file)) != EOF && (c == '#' || c == ' ' || c == '\n' || c == '\r' || c == '\t'))
+	{
+		if (c == '#')
+		{
+			while ((c = fgetc(file)) != EOF && c != '\n');
+		}
+	}
+	ungetc(c, file);
+	if (fscanf(file, "%u %u %u", &width, &height, &max_value) != 3 || max_value != 255)
+	{
+		fclose(file);
+		return -1;
+	}
+	fgetc(file);
+
+	track->width = width;
+	track->height = height;
+	track->mm_per_pixel = mm_per_pixel;
+	track->pixels = malloc((size_t) width * height);
+	if (fread(track->pixels, 1, (size_t) width * height, file) != (size_t) width * height)
+	{
+		free(track->pixels);
+		track->pixels = NULL;
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+	return 0;
+}
+
+/**
+ * @brief  Releases the pixels of a track.
+ *
+ * @return None
+ */
+void track_free(Track* track)
+{
+	free(track->pixels);
+	track->pixels = NULL;
+}
+
+/**
+ * @brief  Brightness of the floor at a point, everything outside of the image is white.
+ *
+ * @param  x position in mm
+ * @param  y position in mm
+ * @return brightness from 0 (black) to 255 (white)
+ */
+uint8_t track_brightness(const Track* track, float x, float y)
+{
+	int32_t column = (int32_t) (x / track->mm_per_pixel);
+	int32_t row = (int32_t) track->height - 1 - (int32_t) (y / track->mm_per_pixel);
+	if (column < 0 || row < 0 || column >= (int32_t) track->width || row >= (int32_t) track->height)
+	{
+		return 255;
+	}
+	return track->pixels[(uint32_t) row * track->width + column];
+}
+
+/**
+ * @brief  Paints a straight stroke with round ends.
+ *
+ * @return None
+ */
+static void paintStroke(Track* track, float x0, float y0, float x1, float y1, float width, uint8_t value)
+{
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	float length2 = dx * dx + dy * dy;
+	float half = width / 2;
+
+	int32_t min_x = (int32_t) (fminf(x0, x1) - half) - 1;
+	int32_t max_x = (int32_t) (fmaxf(x0, x1) + half) + 1;
+	int32_t min_y = (int32_t) (fminf(y0, y1) - half) - 1;
+	int32_t max_y = (int32_t) (fmaxf(y0, y1) + half) + 1;
+
+	for (int32_t y = min_y; y <= max_y; y++)
+	{
+		for (int32_t x = min_x; x <= max_x; x++)
+		{
+			if (x < 0 || y < 0 || x >= (int32_t) track->width || y >= (int32_t) track->height)
+			{
+				continue;
+			}
+			float t = length2 > 0 ? ((x - x0) * dx + (y - y0) * dy) / length2 : 0;
+			t = fminf(fmaxf(t, 0), 1);
+			float ex = x - (x0 + t * dx);
+			float ey = y - (y0 + t * dy);
+			if (ex * ex + ey * ey <= half * half)
+			{
+				track->pixels[(track->height - 1 - y) * track->width + x] = value;
+			}
+		}
+	}
+}
+
+/* Pen that draws the line of the generated track */
+typedef struct
+{
+	Track* track;
+	float x;
+	float y;
+	float heading;
+	uint8_t down;
+} Pen;
+
+static void penStraight(Pen* pen, float length)
+{
+	float x = pen->x + length * cosf(pen->heading);
+	float y = pen->y + length * sinf(pen->heading);
+	if (pen->down)
+	{
+		paintStroke(pen->track, pen->x, pen->y, x, y, LINE_WIDTH, 0);
+	}
+	pen->x = x;
+	pen->y = y;
+}
+
+/* Positive angles turn left */
+static void penArc(Pen* pen, float radius, float degree)
+{
+	int steps = (int) (fabsf(degree) / 3) + 1;
+	float step_angle = degree * (float) M_PI / 180 / steps;
+	float chord = 2 * radius * sinf(fabsf(step_angle) / 2);
+	for (int i = 0; i < steps; i++)
+	{
+		pen->heading += step_angle / 2;
+		penStraight(pen, chord);
+		pen->heading += step_angle / 2;
+	}
+}
+
+/**
+ * @brief  Generates a track with all sections of the real parkour, 1 mm per pixel.
+ *
+ * The line starts where the fixed trajectory of task_followTrajectory() ends.
+ *
+ * @param  track receives the floor
+ * @param  start receives the start pose of the robot
+ * @param  obstacle receives the obstacle on the line
+ * @return None
+ */
+void track_generateParkour(Track* track, TrackPose* start, Obstacle* obstacle)
+{
+	track->width = GENERATED_WIDTH;
+	track->height = GENERATED_HEIGHT;
+	track->mm_per_pixel = 1;
+	track->pixels = malloc(GENERATED_WIDTH * GENERATED_HEIGHT);
+	memset(track->pixels, 255, GENERATED_WIDTH * GENERATED_HEIGHT);
+
+	start->x = 150;
+	start->y = 150;
+	start->theta = (float) M_PI / 2;
+
+	/* End of the trajectory: 470 mm, 150 degree right, 355 mm, 90 degree left, 320 mm */
+	Pen pen = {track, start->x, start->y, start->theta, 0};
+	penStraight(&pen, 470);
+	pen.heading -= 150 * (float) M_PI / 180;
+	penStraight(&pen, 355);
+	pen.heading += 90 * (float) M_PI / 180;
+	penStraight(&pen, 280);
+
+	pen.down = 1;
+	penStraight(&pen, 250);
+	penArc(&pen, 250, 60);
+	penStraight(&pen, 150);
+	pen.down = 0;
+	penStraight(&pen, GAP_LENGTH);
+	pen.down = 1;
+	penStraight(&pen, 200);
+	penArc(&pen, 250, -90);
+	penStraight(&pen, 250);
+
+	obstacle->x = pen.x + 50 * cosf(pen.heading);
+	obstacle->y = pen.y + 50 * sinf(pen.heading);
+	obstacle->radius = OBSTACLE_RADIUS;
+
+	penStraight(&pen, 200);
+	penArc(&pen, 300, -30);
+	penStraight(&pen, 450);
+
+	/* Grey finish line across the end of the line */
+	float nx = -sinf(pen.heading) * FINISH_LENGTH / 2;
+	float ny = cosf(pen.heading) * FINISH_LENGTH / 2;
+	float fx = pen.x + 15 * cosf(pen.heading);
+	float fy = pen.y + 15 * sinf(pen.heading);
+	paintStroke(track, fx - nx, fy - ny, fx + nx, fy + ny, 25, FINISH_GREY);
+}
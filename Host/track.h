@@ -0,0 +1,46 @@
+/**
+ * @brief  Header file for track.c.
+ *
+ * @author Lukas Probst
+ */
+
+#ifndef __TRACK_H__
+#define __TRACK_H__
+
+#include <stdint.h>
+
+/*
+ * Rasterised floor of the parkour. Every pixel holds the brightness of the floor from 0 (black)
+ * to 255 (white). The world coordinates are in mm with the origin in the bottom left corner
+ * and y pointing up.
+ */
+typedef struct
+{
+	uint32_t width;
+	uint32_t height;
+	float mm_per_pixel;
+	uint8_t* pixels;
+} Track;
+
+/* Pose of the robot on the track, theta in rad counter-clockwise from the x axis */
+typedef struct
+{
+	float x;
+	float y;
+	float theta;
+} TrackPose;
+
+/* Round obstacle standing on the track */
+typedef struct
+{
+	float x;
+	float y;
+	float radius;
+} Obstacle;
+
+int track_loadPgm(Track* track, const char* path, float mm_per_pixel);
+void track_generateParkour(Track* track, TrackPose* start, Obstacle* obstacle);
+void track_free(Track* track);
+uint8_t track_brightness(const Track* track, float x, float y);
+
+#endif /* __TRACK_H__ */